@@ -1,24 +1,94 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <opencv2/opencv.hpp>
 
+#include "SalienceLib.h"
+
 using namespace cv;
 
+// Filters JPEG, PNG and every other image OpenCV decodes with the salience tree
+// of ../alpha-tree, without converting it to a .ppm first. make builds it
+// against the library of the default 3x8 build (make lib in ../alpha-tree).
+// With -show the filtered image is also displayed until a key is pressed.
+
+/**
+ * @brief Describes the pixels of a continuous 8 bit RGB image to the library,
+ * which then reads and writes them where they are.
+ */
+static SalienceBuffer ImageBuffer(Mat &image)
+{
+    SalienceBuffer buffer;
+
+    buffer.data = image.data;
+    buffer.width = image.cols;
+    buffer.height = image.rows;
+    buffer.rowStride = (long)image.step;
+    buffer.pixelStride = 3;
+    buffer.channelStride = 1;
+    return buffer;
+}
+
 int main(int argc, char** argv )
 {
-    if ( argc != 2 )
+    int channels, channelBits;
+    bool show = argc > 1 && strcmp(argv[1], "-show") == 0;
+
+    if ( show )
+    {
+        argc--;
+        argv++;
+    }
+    if ( argc < 3 )
+    {
+        printf("usage: %s [-show] <input image> <lambda> [omegafactor] [output image]\n", argv[0]);
+        return -1;
+    }
+    // the pixel type is that of the library, not of the headers
+    SalienceFormat(&channels, &channelBits);
+    if ( channels != 3 || channelBits != 8 )
     {
-        printf("usage: DisplayImage.out <Image_Path>\n");
+        printf("The library has %d channels of %d bits, the frontend decodes 3 channels of 8 bits\n", channels, channelBits);
         return -1;
     }
-    Mat image;
-    image = imread( argv[1], 1 );
+    double lambda = atof(argv[2]);
+    double omegafactor = argc > 3 ? atof(argv[3]) : 200000;
+    const char *outfname = argc > 4 ? argv[4] : "out.png";
+
+    Mat image = imread( argv[1], IMREAD_COLOR );
     if ( !image.data )
     {
         printf("No image data \n");
         return -1;
     }
-    namedWindow("Display Image", WINDOW_AUTOSIZE );
-    imshow("Display Image", image);
-    waitKey(0);
+    // the tree takes the channels in RGB order, OpenCV decodes to BGR
+    Mat rgb;
+    cvtColor(image, rgb, COLOR_BGR2RGB);
+    image.release();
+
+    SalienceBuffer input = ImageBuffer(rgb);
+    SalienceTree *tree = SalienceBuild(&input, lambda, omegafactor);
+    if ( tree == NULL )
+        return -1;
+
+    // the filter writes into the decoded image, which is not needed any more
+    int r = SalienceFilter(tree, &input, lambda, NULL, NULL);
+    SalienceDelete(tree);
+    if ( r != 0 )
+        return -1;
+
+    cvtColor(rgb, image, COLOR_RGB2BGR);
+    if ( !imwrite(outfname, image) )
+    {
+        printf("Can't write the image: %s\n", outfname);
+        return -1;
+    }
+    printf("Filtered image written to '%s'\n", outfname);
+    if ( show )
+    {
+        namedWindow("Filtered Image", WINDOW_AUTOSIZE );
+        imshow("Filtered Image", image);
+        waitKey(0);
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "SalienceLib.h"
+#include "source/SalienceTree.h"
+#include "util/EdgeDetection.h"
+#include "util/TreeFilter.h"
+#include "util/AttributeProfile.h"
+#include "util/PPMImageReadWrite.h"
+#include "util/PageAlloc.h"
+
+// The library takes the place of main.c: the settings have the defaults of the
+// command line program and the images are passed by the caller.
+double ChannelWeight[CHANNELS];
+double MainEdgeWeight = 1.0;
+double OrthogonalEdgeWeight = 1.0;
+
+int width, height;
+Index size;
+int lambda;
+double omegafactor = 200000;
+boolean scanlinePhase1 = false;
+long maxQueueEdges = 0;
+double alphaStep = 0;
+int hugePages = HUGE_PAGES_NONE;
+boolean pageStats = false;
+
+Pixel *gval = NULL;
+Pixel *out = NULL;
+
+/**
+ * @brief Checks whether a buffer holds its pixels row after row without gaps, in
+ * which case it is used as a Pixel array without copying.
+ */
+static boolean IsPixelArray(SalienceBuffer *buffer)
+{
+  return (buffer->channelStride == (long)sizeof(Channel) && buffer->pixelStride == (long)sizeof(Pixel) &&
+          buffer->rowStride == buffer->width * (long)sizeof(Pixel));
+}
+
+/**
+ * @brief Returns the address of a sample of a buffer.
+ */
+static inline Channel *BufferSample(SalienceBuffer *buffer, int x, int y, int c)
+{
+  return ((Channel *)((char *)buffer->data + y * buffer->rowStride + x * buffer->pixelStride + c * buffer->channelStride));
+}
+
+/**
+ * @brief Gives the pixel type of the build, CHANNELS samples of CHANNEL_BITS
+ * bits, which the buffers of the caller have to hold.
+ */
+void SalienceFormat(int *channels, int *channelBits)
+{
+  *channels = CHANNELS;
+  *channelBits = CHANNEL_BITS;
+}
+
+/**
+ * @brief Gives the dimensions of the image of a tree.
+ */
+void SalienceShape(SalienceTree *tree, int *width, int *height)
+{
+  *width = tree->width;
+  *height = (int)(tree->imgSize / tree->width);
+}
+
+/**
+ * @brief Builds the tree of an image in memory. Pixel arrays are read where they
+ * are, other layouts are gathered into one first. The build uses the settings of
+ * the process, so builds must not overlap.
+ *
+ * @param image Image to build the tree of
+ * @param lambdamin Edges below lambdamin are merged in Phase1
+ * @param omega Largest range of a node, as omegafactor of the command line
+ * @return SalienceTree* The tree, NULL on failure
+ */
+SalienceTree *SalienceBuild(SalienceBuffer *image, double lambdamin, double omega)
+{
+  SalienceTree *tree;
+  Pixel *img;
+  Index imgsize = (Index)image->width * image->height;
+  int x, y, c;
+
+  if (image->width <= 0 || image->height <= 0 || !ImageFitsIndex(image->width, image->height))
+    return (NULL);
+  for (c = 0; c < CHANNELS; c++)
+    ChannelWeight[c] = 0.5;
+  omegafactor = omega;
+  if (IsPixelArray(image))
+    img = image->data;
+  else
+  {
+    img = malloc(imgsize * sizeof(Pixel));
+    if (img == NULL)
+    {
+      fprintf(stderr, "Out of memory!");
+      exit(-1);
+    }
+    for (y = 0; y < image->height; y++)
+      for (x = 0; x < image->width; x++)
+        for (c = 0; c < CHANNELS; c++)
+          img[(Index)y * image->width + x][c] = *BufferSample(image, x, y, c);
+  }
+  tree = MakeSalienceTree(img, image->width, image->height, lambdamin);
+  if (img != image->data)
+    free(img);
+  return (tree);
+}
+
+/**
+ * @brief Filters a tree into an image of the caller, with a predicate like that
+ * of -filter or with the salience filter when predicate is NULL. Pixel arrays
+ * are written directly, other layouts through a copy.
+ *
+ * @param tree Tree to filter, the filter writes into its nodes
+ * @param output Image of the size of the tree
+ * @param lambda Lambda of the salience filter
+ * @param predicate Predicate of the attribute filter, NULL for the salience filter
+ * @param rule Decision rule of the attribute filter, NULL for direct
+ * @return int 0 on success, -1 on failure
+ */
+int SalienceFilter(SalienceTree *tree, SalienceBuffer *output, double lambda, char *predicate, char *rule)
+{
+  FilterPredicate filter = {0};
+  int filterRule = FILTER_DIRECT, x, y, c;
+  Pixel *view;
+
+#ifndef ATTRIBUTE_MEAN
+  fprintf(stderr, "Error: Filtering needs a build with the MEAN attribute!");
+  return (-1);
+#endif
+  if (output->width != tree->width || (Index)output->width * output->height != tree->imgSize)
+  {
+    fprintf(stderr, "Error: The output is %dx%d pixels, the tree %dx%ld!", output->width, output->height,
+            tree->width, (long)(tree->imgSize / tree->width));
+    return (-1);
+  }
+  if (predicate != NULL && !ParseFilterPredicate(predicate, &filter))
+    return (-1);
+  if (rule != NULL && (filterRule = ParseFilterRule(rule)) < 0)
+    return (-1);
+
+  view = IsPixelArray(output) ? output->data : malloc(tree->imgSize * sizeof(Pixel));
+  if (view == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  if (predicate != NULL)
+    SalienceTreeAttributeFilter(tree, view, &filter, filterRule);
+  else
+    SalienceTreeSalienceFilter(tree, view, lambda);
+  if (view != output->data)
+  {
+    for (y = 0; y < output->height; y++)
+      for (x = 0; x < output->width; x++)
+        for (c = 0; c < CHANNELS; c++)
+          *BufferSample(output, x, y, c) = view[(Index)y * output->width + x][c];
+    free(view);
+  }
+  return (0);
+}
+
+/**
+ * @brief Computes the attribute profiles of a tree into an array of the caller,
+ * see SalienceTreeAttributeProfiles for the layout.
+ *
+ * @param tree Tree to draw
+ * @param attribute "area" or "salience"
+ * @param lambda Increasing lambdas
+ * @param count Number of lambdas
+ * @param features ProfileFeatures(count) floats per pixel, row after row
+ * @param threads Number of threads
+ * @return int 0 on success, -1 on failure
+ */
+int SalienceProfile(SalienceTree *tree, char *attribute, double *lambda, int count, float *features, int threads)
+{
+  int code = ParseFilterAttribute(attribute, strlen(attribute));
+
+  if (code < 0 || count < 1)
+  {
+    fprintf(stderr, "Error: Profiles need an attribute and at least one lambda!");
+    return (-1);
+  }
+  return (SalienceTreeAttributeProfiles(tree, code, lambda, count, features, threads));
+}
+
+/**
+ * @brief Frees a tree built by SalienceBuild.
+ */
+void SalienceDelete(SalienceTree *tree)
+{
+  DeleteTree(tree);
+}
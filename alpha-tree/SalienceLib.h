@@ -0,0 +1,41 @@
+#ifndef SALIENCE_LIB_H
+#define SALIENCE_LIB_H
+
+// C++ callers get the tree functions with C linkage as well
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The header is kept apart from util/common.h, whose macros would clash with
+// those of the caller, so the tree is opaque here and the pixel type of the
+// build is asked from the library with SalienceFormat
+typedef struct SalienceTree SalienceTree;
+
+// An image in memory of the caller, the channels of SalienceFormat per pixel as
+// unsigned samples of 8 or 16 bits in native byte order.
+// The strides are in bytes and can be negative, so the rows, pixels and channels
+// of a numpy array or any other strided layout are used as they are.
+// The library is built with hidden symbols, only these functions are exported
+#define SALIENCE_API __attribute__((visibility("default")))
+
+typedef struct SalienceBuffer
+{
+  void *data;          /* channel 0 of pixel (0, 0) */
+  int width, height;
+  long rowStride;      /* from a pixel to the one below it */
+  long pixelStride;    /* from a pixel to the one right of it */
+  long channelStride;  /* from a channel to the next one of the same pixel */
+} SalienceBuffer;
+
+SALIENCE_API void SalienceFormat(int *channels, int *channelBits);
+SALIENCE_API void SalienceShape(SalienceTree *tree, int *width, int *height);
+SALIENCE_API SalienceTree *SalienceBuild(SalienceBuffer *image, double lambdamin, double omega);
+SALIENCE_API int SalienceFilter(SalienceTree *tree, SalienceBuffer *output, double lambda, char *predicate, char *rule);
+SALIENCE_API int SalienceProfile(SalienceTree *tree, char *attribute, double *lambda, int count, float *features, int threads);
+SALIENCE_API void SalienceDelete(SalienceTree *tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
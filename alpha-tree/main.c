@@ -9,31 +9,867 @@
 #include <sys/times.h>
 #include <unistd.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "util/common.h"
 #include "util/PPMImageReadWrite.h"
 #include "util/EdgeDetection.h"
 #include "util/TreeFilter.h"
+#include "util/AttributeProfile.h"
+#include "util/HierarchyCut.h"
+#include "util/TreeServer.h"
+#include "util/PageAlloc.h"
 #include "source/EdgeQueue.h"
 #include "source/SalienceTree.h"
+#include "source/TiledTree.h"
+#include "source/VolumeTree.h"
+#include "source/VideoTree.h"
 
-double RGBweight[3] = {0.5, 0.5, 0.5};
+double ChannelWeight[CHANNELS];
 double MainEdgeWeight = 1.0;
 double OrthogonalEdgeWeight = 1.0;
 
 // variables
-int width, height, size;
+int width, height;
+Index size;
 int lambda;
 double omegafactor = 200000;
+boolean scanlinePhase1 = false;
+// finished trees keep only their level roots, see CompactSalienceTree
+boolean compactTree = false;
+long maxQueueEdges = 0;
+// alphas are rounded up to multiples of alphaStep before Phase2, 0 keeps them exact
+double alphaStep = 0;
+// pages of the tree and queue arrays, one of HUGE_PAGES_NONE ... HUGE_PAGES_EXPLICIT
+int hugePages = HUGE_PAGES_NONE;
+// count the TLB misses and page faults of Phase1 and Phase2, see PageCountersReport
+boolean pageStats = false;
 
 // input and output images as arrays of pixel
 Pixel *gval = NULL;
 Pixel *out = NULL;
 
+// dimensions and band layout of a raw input image, rawWidth is 0 for ppm input
+static int rawWidth = 0, rawHeight = 0, rawInterleave = RAW_BIP;
+
+// printf pattern of the file names of the slices of a volume or the frames of a video
+static char *sequencePattern = NULL;
+
+// predicate and decision rule of -filter, the salience filter is used when count is 0
+static FilterPredicate filterPredicate = {0};
+static int filterRule = FILTER_DIRECT;
+
+/**
+ * @brief Handles the options that can be given anywhere on the command line
+ * and removes them from the argument list.
+ * -scanline: form the flat zones in Phase1 from runs of pixels
+ * -compact: remove the nodes that are not level roots from the finished tree
+ * -raw <width> <height> <bip|bil|bsq>: the input image is a raw image with
+ *  CHANNELS bands in the given layout
+ * -filter <predicate>: filter with a predicate on the node attributes, e.g.
+ *  "area >= 100 && salience >= 20 && range <= 60", instead of the salience
+ * -rule <direct|min|max|subtractive>: decision rule of -filter
+ * -maxedges <edges>: raise lambdamin until at most this many edges go to Phase2
+ * -maxqueue <megabytes>: the same for the memory of the edge queue
+ * -quantize <step>: round alphas up to multiples of step
+ * -levels <levels>: the same with the range of edge strengths split in levels steps
+ * -hugepages <transparent|explicit>: map the tree and queue arrays on huge pages
+ * -pagestats: report the dTLB load misses and page faults of the build
+ */
+static void ParseOptions(int *argc, char *argv[])
+{
+  int i, j = 1;
+  double levels = 0;
+
+  for (i = 1; i < *argc; i++)
+  {
+    if (strcmp(argv[i], "-scanline") == 0)
+      scanlinePhase1 = true;
+    else if (strcmp(argv[i], "-compact") == 0)
+      compactTree = true;
+    else if (strcmp(argv[i], "-raw") == 0 && i + 3 < *argc)
+    {
+      rawWidth = atoi(argv[++i]);
+      rawHeight = atoi(argv[++i]);
+      i++;
+      if (strcmp(argv[i], "bil") == 0)
+        rawInterleave = RAW_BIL;
+      else if (strcmp(argv[i], "bsq") == 0)
+        rawInterleave = RAW_BSQ;
+      else
+        rawInterleave = RAW_BIP;
+    }
+    else if (strcmp(argv[i], "-maxedges") == 0 && i + 1 < *argc)
+      maxQueueEdges = atol(argv[++i]);
+    else if (strcmp(argv[i], "-maxqueue") == 0 && i + 1 < *argc)
+      maxQueueEdges = (long)(atof(argv[++i]) * (1 << 20) / sizeof(Edge));
+    else if (strcmp(argv[i], "-quantize") == 0 && i + 1 < *argc)
+    {
+      alphaStep = atof(argv[++i]);
+      levels = 0;
+    }
+    else if (strcmp(argv[i], "-levels") == 0 && i + 1 < *argc)
+      levels = atof(argv[++i]);
+    else if (strcmp(argv[i], "-hugepages") == 0 && i + 1 < *argc)
+    {
+      i++;
+      if (strcmp(argv[i], "explicit") == 0)
+        hugePages = HUGE_PAGES_EXPLICIT;
+      else if (strcmp(argv[i], "transparent") == 0)
+        hugePages = HUGE_PAGES_TRANSPARENT;
+      else
+        hugePages = HUGE_PAGES_NONE;
+    }
+    else if (strcmp(argv[i], "-pagestats") == 0)
+      pageStats = true;
+    else if (strcmp(argv[i], "-filter") == 0 && i + 1 < *argc)
+    {
+      if (!ParseFilterPredicate(argv[++i], &filterPredicate))
+        exit(-1);
+    }
+    else if (strcmp(argv[i], "-rule") == 0 && i + 1 < *argc)
+    {
+      if ((filterRule = ParseFilterRule(argv[++i])) < 0)
+        exit(-1);
+    }
+    else
+      argv[j++] = argv[i];
+  }
+  // a build of one channel reads the three equal channels of a gray ppm image
+  // into one, which carries their weights so the tree is that of 3 channels
+  if (CHANNELS == 1 && rawWidth <= 0)
+    ChannelWeight[0] = 3 * ChannelWeight[0];
+  // the range of edge strengths depends on the final channel weights
+  if (levels > 0)
+    alphaStep = MaxEdgeStrength() / levels;
+  if (alphaStep > 0)
+    fprintf(stderr, "Alphas quantized to multiples of %f, every alpha is less than that above its exact value\n", alphaStep);
+  *argc = j;
+}
+
+/**
+ * @brief Checks whether the output images are binary ppm images, which they are
+ * for 3 channels and for the gray ppm input of builds of one channel.
+ */
+static boolean OutputIsPPM(void)
+{
+  return (CHANNELS == 3 || (CHANNELS == 1 && rawWidth <= 0));
+}
+
+/**
+ * @brief Writes the global out image, as binary ppm when OutputIsPPM and as a
+ * raw image with interleaved bands otherwise.
+ */
+static int ImageWrite(char *fname)
+{
+  if (OutputIsPPM())
+    return (ImagePPMBinWrite(fname));
+  return (ImageRawWrite(fname));
+}
+
+/**
+ * @brief Reads the input image into the global gval array, as ppm or as raw image
+ * when -raw is given.
+ */
+static short ImageRead(char *fname)
+{
+  if (rawWidth > 0 ? !ImageRawRead(fname, rawWidth, rawHeight, rawInterleave) : !ImagePPMRead(fname))
+    return (0);
+  return (1);
+}
+
+/**
+ * @brief Removes the nodes that are not level roots from a finished tree when
+ * -compact is given.
+ */
+static void CompactTree(SalienceTree *tree)
+{
+  long nodes = (long)tree->curSize;
+
+  if (compactTree)
+    fprintf(stderr, "Compacted tree to %ld of %ld nodes\n", (long)CompactSalienceTree(tree), nodes);
+}
+
+/**
+ * @brief Builds the tree of the global gval image with the lambda of the command
+ * line. With -maxedges or -maxqueue the tree reports the lambdamin that keeps
+ * the queue within its budget.
+ *
+ * @return SalienceTree* The tree, NULL on failure
+ */
+static SalienceTree *BuildImageTree(void)
+{
+  SalienceTree *tree = MakeSalienceTree(gval, width, height, (double)lambda);
+
+  if (tree == NULL)
+    return (NULL);
+  if (maxQueueEdges > 0)
+    fprintf(stderr, "lambdamin=%f keeps Phase2 within %ld edges\n", tree->lambdamin, maxQueueEdges);
+  CompactTree(tree);
+  return (tree);
+}
+
+/**
+ * @brief Checks that this build maintains the attributes the filters need.
+ */
+static boolean CanFilter(void)
+{
+#ifdef ATTRIBUTE_MEAN
+  return (true);
+#else
+  fprintf(stderr, "Error: Filtering needs a build with the MEAN attribute!");
+  return (false);
+#endif
+}
+
+/**
+ * @brief Filters a tree into the global out image, with the predicate of -filter
+ * when given and with the salience filter otherwise.
+ */
+static void FilterTree(SalienceTree *tree, double salience)
+{
+  if (filterPredicate.count > 0)
+    SalienceTreeAttributeFilter(tree, out, &filterPredicate, filterRule);
+  else
+    SalienceTreeSalienceFilter(tree, out, salience);
+}
+
+/**
+ * @brief Reads image z of the sequence given by sequencePattern, as binary ppm or
+ * as raw image when -raw is given.
+ */
+static Pixel *ReadSequence(int z, int *slicewidth, int *sliceheight)
+{
+  char fname[FILENAME_MAX];
+  int firstRow = 0, lastRow = INT_MAX;
+
+  snprintf(fname, FILENAME_MAX, sequencePattern, z);
+  if (rawWidth > 0)
+  {
+    *slicewidth = rawWidth;
+    *sliceheight = rawHeight;
+    return (ImageRawReadPixels(fname, rawWidth, rawHeight, rawInterleave));
+  }
+  return (ImagePPMBinReadRows(fname, &firstRow, &lastRow, slicewidth, sliceheight));
+}
+
+/**
+ * @brief Builds the tree of a volume from a stream of slices and writes the
+ * filtered slices.
+ * Usage: -volume <slice pattern> <slices> <lambda> [omegafactor] [output pattern]
+ */
+static int RunVolume(int argc, char *argv[])
+{
+  char fname[FILENAME_MAX], *outpattern = "out-%04d.ppm";
+  SalienceTree *tree;
+  int depth, z, r = 0;
+  clock_t start;
+  struct tms tstruct;
+  long tickspersec = sysconf(_SC_CLK_TCK);
+
+  if (!CanFilter())
+    return (-1);
+
+  if (argc < 5)
+  {
+    printf("Usage: %s -volume <slice pattern> <slices> <lambda> [omegafactor] [output pattern]\n", argv[0]);
+    exit(0);
+  }
+  sequencePattern = argv[2];
+  depth = atoi(argv[3]);
+  lambda = atoi(argv[4]);
+  if (argc > 5)
+    omegafactor = atof(argv[5]);
+  if (argc > 6)
+    outpattern = argv[6];
+
+  printf("Filtering volume '%s' of %d slices with lambda=%d\n", sequencePattern, depth, lambda);
+  start = times(&tstruct);
+  tree = MakeVolumeTree(ReadSequence, depth, (double)lambda, &width, &height);
+  if (tree == NULL)
+    return (-1);
+  CompactTree(tree);
+  printf("Volume: Width=%d Height=%d Depth=%d\n", width, height, depth);
+  printf("wall-clock time: %f s\n", (float)(times(&tstruct) - start) / ((float)tickspersec));
+
+  // the filter fills the slices one after the other
+  size = (Index)width * height;
+  out = malloc((size_t)size * depth * sizeof(Pixel));
+  FilterTree(tree, (double)lambda);
+  for (z = 0; z < depth && r == 0; z++)
+  {
+    snprintf(fname, FILENAME_MAX, outpattern, z);
+    if (OutputIsPPM())
+      r = ImagePPMBinWritePixels(fname, out + (size_t)z * size, width, height);
+    else
+      r = ImageRawWritePixels(fname, out + (size_t)z * size, (size_t)size);
+  }
+  if (r == 0)
+    printf("Filtered slices written to '%s'\n", outpattern);
+  free(out);
+  DeleteTree(tree);
+  return (r);
+}
+
+/**
+ * @brief Filters the frames of a video one after the other. The tree of every
+ * frame is built from the tree of the previous frame.
+ * Usage: -video <frame pattern> <frames> <lambda> [omegafactor] [output pattern]
+ */
+static int RunVideo(int argc, char *argv[])
+{
+  char fname[FILENAME_MAX], *outpattern = "out-%04d.ppm";
+  VideoTree *video = NULL;
+  SalienceTree *tree;
+  Pixel *frame;
+  int frames, i, framewidth, frameheight, r = 0;
+  Index changed;
+  long totalChanged = 0, totalKept = 0, totalEdges = 0;
+  clock_t start;
+  struct tms tstruct;
+  long tickspersec = sysconf(_SC_CLK_TCK);
+  float musec;
+
+  if (!CanFilter())
+    return (-1);
+
+  if (argc < 5)
+  {
+    printf("Usage: %s -video <frame pattern> <frames> <lambda> [omegafactor] [output pattern]\n", argv[0]);
+    exit(0);
+  }
+  sequencePattern = argv[2];
+  frames = atoi(argv[3]);
+  lambda = atoi(argv[4]);
+  if (argc > 5)
+    omegafactor = atof(argv[5]);
+  if (argc > 6)
+    outpattern = argv[6];
+
+  printf("Filtering video '%s' of %d frames with lambda=%d\n", sequencePattern, frames, lambda);
+  start = times(&tstruct);
+  for (i = 0; i < frames && r == 0; i++)
+  {
+    frame = ReadSequence(i, &framewidth, &frameheight);
+    if (frame == NULL)
+    {
+      r = -1;
+      break;
+    }
+    if (video == NULL && !ImageFitsIndex(framewidth, frameheight))
+    {
+      free(frame);
+      r = -1;
+      break;
+    }
+    if (video == NULL)
+    {
+      width = framewidth;
+      height = frameheight;
+      size = (Index)width * height;
+      video = CreateVideoTree(width, height, (double)lambda);
+      out = malloc(size * sizeof(Pixel));
+    }
+    else if (framewidth != width || frameheight != height)
+    {
+      fprintf(stderr, "Error: Frame %d is %dx%d instead of %dx%d!", i, framewidth, frameheight, width, height);
+      free(frame);
+      r = -1;
+      break;
+    }
+    tree = VideoTreeUpdate(video, frame, &changed);
+    totalChanged += changed;
+    totalKept += video->keptNodes;
+    totalEdges += video->workCount;
+    FilterTree(tree, (double)lambda);
+    snprintf(fname, FILENAME_MAX, outpattern, i);
+    r = ImageWrite(fname);
+  }
+  musec = (float)(times(&tstruct) - start) / ((float)tickspersec);
+  printf("wall-clock time: %f s, %f s per frame\n", musec, musec / MAX(i, 1));
+  printf("Changed pixels per frame: %ld\n", totalChanged / MAX(i, 1));
+  printf("Kept nodes per frame: %ld, Phase2 edges per frame: %ld\n", totalKept / MAX(i, 1), totalEdges / MAX(i, 1));
+  if (r == 0)
+    printf("Filtered frames written to '%s'\n", outpattern);
+  if (video != NULL)
+  {
+    free(out);
+    DeleteVideoTree(video);
+  }
+  return (r);
+}
+
+/**
+ * @brief Builds the tree of an image and writes the pattern spectra of one or
+ * more attributes, as CSV when the output file ends in ".csv" and binary otherwise.
+ * Usage: -spectrum <input image> <lambda> <output file> <attribute>:<lambda>,...
+ */
+static int RunSpectrum(int argc, char *argv[])
+{
+  PatternSpectrum **spectra;
+  SalienceTree *tree;
+  int k, count = argc - 5, r = -1;
+  clock_t start;
+  struct tms tstruct;
+  long tickspersec = sysconf(_SC_CLK_TCK);
+
+  if (!CanFilter())
+    return (-1);
+
+  if (argc < 6)
+  {
+    printf("Usage: %s -spectrum <input image> <lambda> <output file> <attribute>:<lambda>,... [<attribute>:<lambda>,...]...\n", argv[0]);
+    exit(0);
+  }
+  spectra = calloc(count, sizeof(PatternSpectrum *));
+  for (k = 0; k < count; k++)
+  {
+    if ((spectra[k] = ParsePatternSpectrum(argv[5 + k])) == NULL)
+      break;
+  }
+  lambda = atoi(argv[3]);
+  if (k == count && ImageRead(argv[2]))
+  {
+    start = times(&tstruct);
+    tree = BuildImageTree();
+    if (tree != NULL)
+    {
+      SalienceTreePatternSpectra(tree, spectra, count);
+      printf("wall-clock time: %f s\n", (float)(times(&tstruct) - start) / ((float)tickspersec));
+      r = WritePatternSpectra(argv[4], spectra, count);
+      if (r == 0)
+        printf("Pattern spectra written to '%s'\n", argv[4]);
+      DeleteTree(tree);
+    }
+    free(gval);
+  }
+  for (k = 0; k < count; k++)
+    if (spectra[k] != NULL)
+      DeletePatternSpectrum(spectra[k]);
+  free(spectra);
+  return (r);
+}
+
+/**
+ * @brief Builds the tree of an image and writes the area or salience profiles of
+ * every pixel to a file of floats, see WriteAttributeProfiles.
+ * Usage: -profile <input image> <lambda> <output file> <area|salience>:<lambda>,...
+ */
+static int RunProfile(int argc, char *argv[])
+{
+  PatternSpectrum *levels;
+  SalienceTree *tree;
+  int r = -1;
+  clock_t start;
+  struct tms tstruct;
+  long tickspersec = sysconf(_SC_CLK_TCK);
+
+  if (!CanFilter())
+    return (-1);
+
+  if (argc < 6)
+  {
+    printf("Usage: %s -profile <input image> <lambda> <output file> <area|salience>:<lambda>,...\n", argv[0]);
+    exit(0);
+  }
+  // the lambdas are given like the bins of a pattern spectrum
+  if ((levels = ParsePatternSpectrum(argv[5])) == NULL)
+    return (-1);
+  lambda = atoi(argv[3]);
+  if (ImageRead(argv[2]))
+  {
+    start = times(&tstruct);
+    tree = BuildImageTree();
+    if (tree != NULL)
+    {
+      r = WriteAttributeProfiles(tree, levels->attribute, levels->lambda, levels->count, argv[4],
+                                 (int)sysconf(_SC_NPROCESSORS_ONLN));
+      printf("wall-clock time: %f s\n", (float)(times(&tstruct) - start) / ((float)tickspersec));
+      if (r == 0)
+        printf("Profiles of %dx%dx%d floats written to '%s'\n", height, width, ProfileFeatures(levels->count), argv[4]);
+      DeleteTree(tree);
+    }
+    free(gval);
+  }
+  DeletePatternSpectrum(levels);
+  return (r);
+}
+
+/**
+ * @brief Builds the tree of an image and writes the labels of the partition with
+ * at most the given number of regions, as one native-endian 32 bit unsigned
+ * integer per pixel.
+ * Usage: -cut <input image> <lambda> <regions> <label file>
+ */
+static int RunCut(int argc, char *argv[])
+{
+  HierarchyIndex *index;
+  SalienceTree *tree;
+  uint32_t *labels;
+  FILE *outfile;
+  int regions, r = 0;
+  double alpha;
+  clock_t start;
+  struct tms tstruct;
+  long tickspersec = sysconf(_SC_CLK_TCK);
+
+  if (argc < 6)
+  {
+    printf("Usage: %s -cut <input image> <lambda> <regions> <label file>\n", argv[0]);
+    exit(0);
+  }
+  lambda = atoi(argv[3]);
+  if (!ImageRead(argv[2]))
+    return (-1);
+  start = times(&tstruct);
+  tree = BuildImageTree();
+  if (tree == NULL)
+  {
+    free(gval);
+    return (-1);
+  }
+  index = CreateHierarchyIndex(tree);
+  alpha = HierarchyIndexAlpha(index, atoi(argv[4]), &regions);
+  labels = malloc(size * sizeof(uint32_t));
+  if (labels == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  regions = SalienceTreeCutLabels(tree, alpha, labels);
+  printf("wall-clock time: %f s\n", (float)(times(&tstruct) - start) / ((float)tickspersec));
+  printf("Cut at alpha=%f into %d regions\n", alpha, regions);
+
+  outfile = fopen(argv[5], "wb");
+  if (outfile == NULL)
+  {
+    fprintf(stderr, "Error: Can't write the labels: %s !", argv[5]);
+    r = -1;
+  }
+  else
+  {
+    fwrite(labels, sizeof(uint32_t), size, outfile);
+    fclose(outfile);
+    printf("Labels written to '%s'\n", argv[5]);
+  }
+  free(labels);
+  DeleteHierarchyIndex(index);
+  DeleteTree(tree);
+  free(gval);
+  return (r);
+}
+
+/**
+ * @brief Builds the tree of an image and writes a rectangle of the output of
+ * the salience filter, or of -filter with the direct rule, rendered without
+ * filtering the rest of the image.
+ * Usage: -region <input image> <lambda> <x> <y> <width> <height> <output image>
+ */
+static int RunRegion(int argc, char *argv[])
+{
+  SalienceTree *tree;
+  int x, y, r;
+  clock_t start;
+  struct tms tstruct;
+  long tickspersec = sysconf(_SC_CLK_TCK);
+
+  if (!CanFilter())
+    return (-1);
+
+  if (argc < 9)
+  {
+    printf("Usage: %s -region <input image> <lambda> <x> <y> <width> <height> <output image>\n", argv[0]);
+    exit(0);
+  }
+  lambda = atoi(argv[3]);
+  if (!ImageRead(argv[2]))
+    return (-1);
+  tree = BuildImageTree();
+  free(gval);
+  if (tree == NULL)
+    return (-1);
+
+  // the output image is the rectangle
+  x = atoi(argv[4]);
+  y = atoi(argv[5]);
+  width = atoi(argv[6]);
+  height = atoi(argv[7]);
+  size = (Index)width * height;
+  out = malloc(size * sizeof(Pixel));
+  start = times(&tstruct);
+  if (filterPredicate.count > 0)
+    SalienceTreeRegionFilter(tree, out, x, y, width, height, &filterPredicate);
+  else
+    SalienceTreeSalienceRegion(tree, out, x, y, width, height, (double)lambda);
+  printf("wall-clock time: %f s\n", (float)(times(&tstruct) - start) / ((float)tickspersec));
+  r = ImageWrite(argv[8]);
+  if (r == 0)
+    printf("Region of %dx%d pixels written to '%s'\n", width, height, argv[8]);
+  free(out);
+  DeleteTree(tree);
+  return (r);
+}
+
+/**
+ * @brief Keeps the trees of recently used images and serves filtered images and
+ * rectangles of them over a Unix domain socket, see RunTreeServer.
+ * Usage: -serve <socket> [cached trees]
+ */
+static int RunServer(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    printf("Usage: %s -serve <socket> [cached trees]\n", argv[0]);
+    exit(0);
+  }
+  return (RunTreeServer(argv[2], argc > 3 ? atoi(argv[3]) : 4));
+}
+
+/**
+ * @brief Builds the tree of an image and writes its ultrametric contour map, see
+ * SalienceTreeContourMap, as native-endian floats.
+ * Usage: -ucm <input image> <lambda> <output file>
+ */
+static int RunContourMap(int argc, char *argv[])
+{
+  SalienceTree *tree;
+  FILE *outfile;
+  float *ucm;
+  size_t gridsize;
+  int r = 0;
+  clock_t start;
+  struct tms tstruct;
+  long tickspersec = sysconf(_SC_CLK_TCK);
+
+  if (argc < 5)
+  {
+    printf("Usage: %s -ucm <input image> <lambda> <output file>\n", argv[0]);
+    exit(0);
+  }
+  lambda = atoi(argv[3]);
+  if (!ImageRead(argv[2]))
+    return (-1);
+  start = times(&tstruct);
+  tree = BuildImageTree();
+  if (tree == NULL)
+  {
+    free(gval);
+    return (-1);
+  }
+  gridsize = (size_t)(2 * width + 1) * (2 * height + 1);
+  ucm = malloc(gridsize * sizeof(float));
+  if (ucm == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  SalienceTreeContourMap(tree, ucm);
+  printf("wall-clock time: %f s\n", (float)(times(&tstruct) - start) / ((float)tickspersec));
+
+  outfile = fopen(argv[4], "wb");
+  if (outfile == NULL)
+  {
+    fprintf(stderr, "Error: Can't write the contour map: %s !", argv[4]);
+    r = -1;
+  }
+  else
+  {
+    fwrite(ucm, sizeof(float), gridsize, outfile);
+    fclose(outfile);
+    printf("Contour map of %dx%d floats written to '%s'\n", 2 * width + 1, 2 * height + 1, argv[4]);
+  }
+  free(ucm);
+  DeleteTree(tree);
+  free(gval);
+  return (r);
+}
+
+/**
+ * @brief Builds the partial tree of one tile of an image.
+ * Usage: -tile <input image> <lambda> <first row> <last row> <partial tree>
+ */
+static int RunTileWorker(int argc, char *argv[])
+{
+  if (argc < 7)
+  {
+    printf("Usage: %s -tile <input image> <lambda> <first row> <last row> <partial tree>\n", argv[0]);
+    exit(0);
+  }
+  return (BuildTile(argv[2], atof(argv[3]), atoi(argv[4]), atoi(argv[5]), argv[6]) ? 0 : -1);
+}
+
+/**
+ * @brief Merges the partial trees of all tiles and filters the result. The tree
+ * of the whole image is built in this process, which takes the memory of a full build.
+ * Usage: -merge <lambda> <output image> <partial tree>...
+ */
+static int RunTileMerge(int argc, char *argv[])
+{
+  SalienceTree *tree;
+  int r;
+
+  if (!CanFilter())
+    return (-1);
+
+  if (argc < 5)
+  {
+    printf("Usage: %s -merge <lambda> <output image> <partial tree>...\n", argv[0]);
+    printf("The merge builds the tree of the whole image and takes the memory of a full build\n");
+    exit(0);
+  }
+  lambda = atoi(argv[2]);
+  tree = MergeTiles(argv + 4, argc - 4, &width, &height);
+  if (tree == NULL)
+    return (-1);
+  CompactTree(tree);
+  size = (Index)width * height;
+  out = malloc(size * sizeof(Pixel));
+  FilterTree(tree, (double)lambda);
+  r = ImageWrite(argv[3]);
+  if (r == 0)
+    printf("Filtered image written to '%s'\n", argv[3]);
+  free(out);
+  DeleteTree(tree);
+  return (r);
+}
+
+#if INDEX_BITS == 32 || (CHANNELS == 3 && CHANNEL_BITS == 8)
+/**
+ * @brief Returns the input image of the modes that read a whole image, NULL for
+ * the others. The tiled modes read windows and the volume and video modes check
+ * their own limits.
+ */
+static char *InputImage(int argc, char *argv[])
+{
+  if (argc < 2 || argv[1][0] != '-')
+    return (argc > 1 ? argv[1] : NULL);
+  if (argc > 2 && (strcmp(argv[1], "-spectrum") == 0 || strcmp(argv[1], "-profile") == 0 ||
+                   strcmp(argv[1], "-cut") == 0 || strcmp(argv[1], "-region") == 0 ||
+                   strcmp(argv[1], "-ucm") == 0))
+    return (argv[2]);
+  return (NULL);
+}
+
+/**
+ * @brief Returns the path of this build in newly allocated memory with room for
+ * extra characters. argv[0] is only a name when the shell found this build
+ * through PATH, so the path is taken from /proc/self/exe when possible.
+ */
+static char *BuildPath(char *argv0, size_t extra)
+{
+  char self[PATH_MAX], *path;
+  ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+
+  if (length > 0)
+    self[length] = '\0';
+  path = malloc((length > 0 ? (size_t)length : strlen(argv0)) + extra + 1);
+  if (path == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  strcpy(path, length > 0 ? self : argv0);
+  return (path);
+}
+
+/**
+ * @brief Runs another build with the arguments given to this one, returns only
+ * when that build can not be run.
+ */
+static void RunBuild(char *path, char *fullArgv[])
+{
+  char *self = fullArgv[0];
+
+  fullArgv[0] = path;
+  execvp(path, fullArgv);
+  fullArgv[0] = self;
+}
+#endif
+
+#if INDEX_BITS == 32
+/**
+ * @brief Hands images with more pixels than the Index type of this build can
+ * number over to the build with INDEX_BITS=64, which is named after this one
+ * with -i64 appended. Smaller images stay on the faster 32 bit indices.
+ *
+ * @param argc Number of arguments after ParseOptions
+ * @param argv Arguments after ParseOptions
+ * @param fullArgv The arguments as given, options included
+ */
+static void SelectIndexBuild(int argc, char *argv[], char *fullArgv[])
+{
+  char *fname = InputImage(argc, argv), *wide;
+  int imgwidth = rawWidth, imgheight = rawHeight;
+
+  if (fname == NULL || (rawWidth <= 0 && !ImagePPMSize(fname, &imgwidth, &imgheight)))
+    return;
+  if ((long)imgwidth * imgheight <= INDEX_PIXELS_MAX)
+    return;
+  wide = BuildPath(fullArgv[0], strlen("-i64"));
+  strcat(wide, "-i64");
+  fprintf(stderr, "Image of %dx%d pixels, running %s\n", imgwidth, imgheight, wide);
+  RunBuild(wide, fullArgv);
+  // no 64 bit build next to this one, the readers report the error
+  free(wide);
+}
+#endif
+
+#if CHANNELS == 3 && CHANNEL_BITS == 8
+/**
+ * @brief Hands gray ppm images over to the build with CHANNELS=1, which is named
+ * after this one with -1x8 inserted after saliencetree. It reads the equal
+ * channels into one weighted like all three, so it builds the same trees and
+ * writes the same images with a single difference per edge and a third of the
+ * pixel memory. Spectra and profiles have values per channel and raw images no
+ * ppm output, those stay in this build. make builds the one of one channel
+ * with this one; when it is missing, gray images stay here with a warning.
+ *
+ * @param argc Number of arguments after ParseOptions
+ * @param argv Arguments after ParseOptions
+ * @param fullArgv The arguments as given, options included
+ */
+static void SelectGrayBuild(int argc, char *argv[], char *fullArgv[])
+{
+  char *fname = InputImage(argc, argv), *path, *name, *gray;
+  size_t prefix = strlen("saliencetree");
+
+  if (fname == NULL || rawWidth > 0 || strcmp(argv[1], "-spectrum") == 0 || strcmp(argv[1], "-profile") == 0)
+    return;
+  path = BuildPath(fullArgv[0], 0);
+  name = strrchr(path, '/');
+  name = (name == NULL) ? path : name + 1;
+  if (strncmp(name, "saliencetree", prefix) != 0)
+  {
+    free(path);
+    return;
+  }
+  prefix += name - path;
+  gray = malloc(strlen(path) + strlen("-1x8") + 1);
+  if (gray == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  sprintf(gray, "%.*s-1x8%s", (int)prefix, path, path + prefix);
+  if (ImagePPMIsGray(fname))
+  {
+    if (access(gray, X_OK) != 0)
+      fprintf(stderr, "Warning: gray image, but there is no %s, built by make next to this one!\n", gray);
+    else
+    {
+      fprintf(stderr, "Gray image, running %s\n", gray);
+      RunBuild(gray, fullArgv);
+    }
+  }
+  free(gray);
+  free(path);
+}
+#endif
+
 int main(int argc, char *argv[])
 {
 
-  char *imgfname, *outfname = "out.ppm";
+  char *imgfname, *outfname = "out.ppm", **fullArgv;
   int r;
   unsigned long i;
   clock_t start;
@@ -42,10 +878,50 @@ int main(int argc, char *argv[])
   float musec;
   SalienceTree *tree;
 
+  for (i = 0; i < CHANNELS; i++)
+    ChannelWeight[i] = 0.5;
+  fullArgv = malloc((argc + 1) * sizeof(char *));
+  if (fullArgv == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  memcpy(fullArgv, argv, (argc + 1) * sizeof(char *));
+  ParseOptions(&argc, argv);
+#if INDEX_BITS == 32
+  SelectIndexBuild(argc, argv, fullArgv);
+#endif
+#if CHANNELS == 3 && CHANNEL_BITS == 8
+  SelectGrayBuild(argc, argv, fullArgv);
+#endif
+  free(fullArgv);
+
+  // tiled construction runs the two halves of the build in separate processes
+  if (argc > 1 && strcmp(argv[1], "-tile") == 0)
+    return (RunTileWorker(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-merge") == 0)
+    return (RunTileMerge(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-volume") == 0)
+    return (RunVolume(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-video") == 0)
+    return (RunVideo(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-spectrum") == 0)
+    return (RunSpectrum(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-profile") == 0)
+    return (RunProfile(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-cut") == 0)
+    return (RunCut(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-region") == 0)
+    return (RunRegion(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-serve") == 0)
+    return (RunServer(argc, argv));
+  if (argc > 1 && strcmp(argv[1], "-ucm") == 0)
+    return (RunContourMap(argc, argv));
+
   // Check if the right amount of arguments are provided and set variables accirding to them
   if (argc < 3)
   {
-    printf("Usage: %s <input image> <lambda>  [omegafactor] [output image] \n", argv[0]);
+    printf("Usage: %s [-scanline] [-compact] [-raw <width> <height> <bip|bil|bsq>] [-filter <predicate>] [-rule <direct|min|max|subtractive>] [-maxedges <edges>] [-maxqueue <megabytes>] [-quantize <step>] [-levels <levels>] [-hugepages <transparent|explicit>] [-pagestats] <input image> <lambda>  [omegafactor] [output image] \n", argv[0]);
     exit(0);
   }
 
@@ -61,7 +937,7 @@ int main(int argc, char *argv[])
   // Read the input image
   // This sets both the global gval pixel array (input image)
   // as well as the dimensions of the image (height, width, size)
-  if (!ImagePPMRead(imgfname))
+  if (!ImageRead(imgfname))
     return (-1);
 
   // allocate space for the pixel array that is the output image
@@ -73,24 +949,42 @@ int main(int argc, char *argv[])
   printf("Data read, start filtering.\n");
   start = times(&tstruct);
   // create the actual alpha tree
-  tree = MakeSalienceTree(gval, width, height, (double)lambda);
+  tree = BuildImageTree();
+  if (tree == NULL)
+  {
+    free(out);
+    free(gval);
+    return (-1);
+  }
 
   musec = (float)(times(&tstruct) - start) / ((float)tickspersec);
 
   printf("wall-clock time: %f s\n", musec);
+#ifndef ATTRIBUTE_MEAN
+  // without the mean there is nothing to filter with, only the hierarchy is built
+  printf("Hierarchy of %ld nodes built, this build has no attributes to filter with\n", (long)tree->curSize);
+  DeleteTree(tree);
+  free(out);
+  free(gval);
+  return (0);
+#endif
   // apply what we have found in the alpha tree creation to the out image
   // here colors and areas are created etc.
   // SalienceTreeAreaFilter(tree,out,lambda);
-  SalienceTreeSalienceFilter(tree, out, (double)lambda);
+  FilterTree(tree, (double)lambda);
 
   musec = (float)(times(&tstruct) - start) / ((float)tickspersec);
 
   printf("wall-clock time: %f s\n", musec);
 
-  r = ImagePPMBinWrite(outfname);
+  r = ImageWrite(outfname);
 
-  SalienceTreeSalienceFilter(tree, out, (double)(2 * lambda));
-  r = ImagePPMBinWrite("out-2.ppm");
+  // the second image doubles the salience threshold, a -filter predicate has none
+  if (filterPredicate.count == 0)
+  {
+    SalienceTreeSalienceFilter(tree, out, (double)(2 * lambda));
+    r = ImageWrite("out-2.ppm");
+  }
 
   free(out);
   if (r)
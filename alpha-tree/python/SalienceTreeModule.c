@@ -0,0 +1,191 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "../SalienceLib.h"
+#include "../util/AttributeProfile.h"
+
+// The module passes the memory of numpy arrays, or of any other object with the
+// buffer protocol, to SalienceLib.h as it is. Trees are capsules that free
+// their tree when they are collected. The GIL is held during every call, which
+// keeps the builds from overlapping.
+
+#define TREE_CAPSULE "saliencetree.Tree"
+
+/**
+ * @brief Gets a height x width x CHANNELS buffer of samples of type Channel, a
+ * height x width buffer for builds of one channel.
+ *
+ * @return int 1 on success, 0 with an exception set otherwise
+ */
+static int GetImageBuffer(PyObject *object, Py_buffer *view, SalienceBuffer *buffer, int writable)
+{
+  char *format;
+
+  if (PyObject_GetBuffer(object, view, PyBUF_STRIDES | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0)) != 0)
+    return (0);
+  format = view->format;
+  if (*format == '@' || *format == '=' || *format == '<')
+    format++;
+  if (view->itemsize != sizeof(Channel) || strcmp(format, CHANNEL_BITS == 8 ? "B" : "H") != 0 ||
+      (!(view->ndim == 3 && view->shape[2] == CHANNELS) && !(view->ndim == 2 && CHANNELS == 1)))
+  {
+    PyErr_Format(PyExc_ValueError, "expected a height x width x %d array of uint%d", CHANNELS, CHANNEL_BITS);
+    PyBuffer_Release(view);
+    return (0);
+  }
+  buffer->data = view->buf;
+  buffer->height = view->shape[0];
+  buffer->width = view->shape[1];
+  buffer->rowStride = view->strides[0];
+  buffer->pixelStride = view->strides[1];
+  buffer->channelStride = view->ndim == 3 ? view->strides[2] : (long)sizeof(Channel);
+  return (1);
+}
+
+static void DeleteTreeCapsule(PyObject *capsule)
+{
+  SalienceDelete(PyCapsule_GetPointer(capsule, TREE_CAPSULE));
+}
+
+/**
+ * @brief build(image, lambdamin, omega=200000) -> tree
+ */
+static PyObject *Build(PyObject *Py_UNUSED(self), PyObject *args, PyObject *kwargs)
+{
+  static char *keywords[] = {"image", "lambdamin", "omega", NULL};
+  PyObject *image;
+  Py_buffer view;
+  SalienceBuffer buffer;
+  SalienceTree *tree;
+  double lambdamin, omega = 200000;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Od|d", keywords, &image, &lambdamin, &omega))
+    return (NULL);
+  if (!GetImageBuffer(image, &view, &buffer, 0))
+    return (NULL);
+  tree = SalienceBuild(&buffer, lambdamin, omega);
+  PyBuffer_Release(&view);
+  if (tree == NULL)
+  {
+    PyErr_SetString(PyExc_ValueError, "the tree of the image can not be built");
+    return (NULL);
+  }
+  return (PyCapsule_New(tree, TREE_CAPSULE, DeleteTreeCapsule));
+}
+
+/**
+ * @brief filter(tree, out, lambda=0, predicate=None, rule=None)
+ */
+static PyObject *Filter(PyObject *Py_UNUSED(self), PyObject *args, PyObject *kwargs)
+{
+  static char *keywords[] = {"tree", "out", "lambda", "predicate", "rule", NULL};
+  PyObject *capsule, *output;
+  Py_buffer view;
+  SalienceBuffer buffer;
+  SalienceTree *tree;
+  double lambda = 0;
+  char *predicate = NULL, *rule = NULL;
+  int r;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|dzz", keywords, &capsule, &output, &lambda, &predicate, &rule))
+    return (NULL);
+  if ((tree = PyCapsule_GetPointer(capsule, TREE_CAPSULE)) == NULL)
+    return (NULL);
+  if (!GetImageBuffer(output, &view, &buffer, 1))
+    return (NULL);
+  r = SalienceFilter(tree, &buffer, lambda, predicate, rule);
+  PyBuffer_Release(&view);
+  if (r != 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "the tree can not be filtered with these arguments");
+    return (NULL);
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * @brief profile(tree, out, attribute, lambdas, threads=1), out is a C-contiguous
+ * float32 array of height x width x features(len(lambdas)) values
+ */
+static PyObject *Profile(PyObject *Py_UNUSED(self), PyObject *args, PyObject *kwargs)
+{
+  static char *keywords[] = {"tree", "out", "attribute", "lambdas", "threads", NULL};
+  PyObject *capsule, *output, *sequence, *lambdas;
+  Py_buffer view;
+  SalienceTree *tree;
+  char *attribute;
+  double *lambda;
+  int count, k, threads = 1, r = -1;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOsO|i", keywords, &capsule, &output, &attribute, &sequence, &threads))
+    return (NULL);
+  if ((tree = PyCapsule_GetPointer(capsule, TREE_CAPSULE)) == NULL)
+    return (NULL);
+  if ((lambdas = PySequence_Fast(sequence, "lambdas must be a sequence")) == NULL)
+    return (NULL);
+  count = PySequence_Fast_GET_SIZE(lambdas);
+  lambda = PyMem_Malloc((count + 1) * sizeof(double));
+  for (k = 0; lambda != NULL && k < count; k++)
+    lambda[k] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(lambdas, k));
+  Py_DECREF(lambdas);
+  if (lambda == NULL)
+    return (PyErr_NoMemory());
+  if (PyErr_Occurred())
+  {
+    PyMem_Free(lambda);
+    return (NULL);
+  }
+  if (PyObject_GetBuffer(output, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE) != 0)
+  {
+    PyMem_Free(lambda);
+    return (NULL);
+  }
+  if (view.itemsize != sizeof(float) || strcmp(view.format, "f") != 0 ||
+      view.len != (Py_ssize_t)tree->imgSize * ProfileFeatures(count) * (Py_ssize_t)sizeof(float))
+    PyErr_Format(PyExc_ValueError, "expected a float32 array of height x width x %d values", ProfileFeatures(count));
+  else if ((r = SalienceProfile(tree, attribute, lambda, count, view.buf, threads)) != 0)
+    PyErr_SetString(PyExc_ValueError, "the profiles can not be computed with these arguments");
+  PyBuffer_Release(&view);
+  PyMem_Free(lambda);
+  if (r != 0)
+    return (NULL);
+  Py_RETURN_NONE;
+}
+
+/**
+ * @brief shape(tree) -> (height, width)
+ */
+static PyObject *Shape(PyObject *Py_UNUSED(self), PyObject *capsule)
+{
+  SalienceTree *tree = PyCapsule_GetPointer(capsule, TREE_CAPSULE);
+
+  if (tree == NULL)
+    return (NULL);
+  return (Py_BuildValue("(ni)", (Py_ssize_t)(tree->imgSize / tree->width), tree->width));
+}
+
+static PyMethodDef SalienceTreeMethods[] = {
+  {"build", (PyCFunction)(void (*)(void))Build, METH_VARARGS | METH_KEYWORDS,
+   "build(image, lambdamin, omega=200000) -> tree of a height x width x channels array"},
+  {"filter", (PyCFunction)(void (*)(void))Filter, METH_VARARGS | METH_KEYWORDS,
+   "filter(tree, out, lambda=0, predicate=None, rule=None) writes the filtered image into out"},
+  {"profile", (PyCFunction)(void (*)(void))Profile, METH_VARARGS | METH_KEYWORDS,
+   "profile(tree, out, attribute, lambdas, threads=1) writes the attribute profiles into out"},
+  {"shape", Shape, METH_O, "shape(tree) -> (height, width)"},
+  {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef SalienceTreeModule = {
+  PyModuleDef_HEAD_INIT, "saliencetree", "Salience trees of images in memory", -1, SalienceTreeMethods, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_saliencetree(void)
+{
+  PyObject *module = PyModule_Create(&SalienceTreeModule);
+
+  if (module == NULL)
+    return (NULL);
+  PyModule_AddIntConstant(module, "CHANNELS", CHANNELS);
+  PyModule_AddIntConstant(module, "CHANNEL_BITS", CHANNEL_BITS);
+  return (module);
+}
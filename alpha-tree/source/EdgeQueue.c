@@ -1,17 +1,21 @@
 #include "EdgeQueue.h"
+#include "../util/common.h"
+#include "../util/PageAlloc.h"
+#include <stdio.h>
 #include <stdlib.h>
 
 /**
  * @brief Allocates space for a new EdgeQueue and initializes its values.
+ * The queue grows when more edges are pushed than it was created for.
  * 
- * @param maxsize Maximum amount of Edges the queue can hold
+ * @param maxsize Amount of Edges the queue can initially hold
  * @return EdgeQueue* The created queue
  */
 EdgeQueue *EdgeQueueCreate(long maxsize)
 {
   EdgeQueue *newQueue = (EdgeQueue *)malloc(sizeof(EdgeQueue));
   newQueue->size = 0;
-  newQueue->queue = (Edge *)malloc((maxsize + 1) * sizeof(Edge));
+  newQueue->queue = LargeAlloc((maxsize + 1) * sizeof(Edge));
   newQueue->maxsize = maxsize;
   return newQueue;
 }
@@ -23,17 +27,16 @@ EdgeQueue *EdgeQueueCreate(long maxsize)
  */
 void EdgeQueueDelete(EdgeQueue *oldqueue)
 {
-  free(oldqueue->queue);
+  LargeFree(oldqueue->queue);
   free(oldqueue);
 }
 
 void EdgeQueuePop(EdgeQueue *queue)
 {
-  int current = 1;
+  Index current = 1;
   Edge moved;
   // we want to pop the edge at the end of the queue
-  moved.p = queue->queue[queue->size].p;
-  moved.q = queue->queue[queue->size].q;
+  moved.pixel = queue->queue[queue->size].pixel;
   moved.alpha = queue->queue[queue->size].alpha;
 
   queue->size--;
@@ -49,22 +52,19 @@ void EdgeQueuePop(EdgeQueue *queue)
         (queue->queue[current * 2].alpha >
          queue->queue[current * 2 + 1].alpha))
     {
-      queue->queue[current].p = queue->queue[current * 2 + 1].p;
-      queue->queue[current].q = queue->queue[current * 2 + 1].q;
+      queue->queue[current].pixel = queue->queue[current * 2 + 1].pixel;
       queue->queue[current].alpha = queue->queue[current * 2 + 1].alpha;
       current += current + 1;
     }
     // left child is the lower alpha
     else
     {
-      queue->queue[current].p = queue->queue[current * 2].p;
-      queue->queue[current].q = queue->queue[current * 2].q;
+      queue->queue[current].pixel = queue->queue[current * 2].pixel;
       queue->queue[current].alpha = queue->queue[current * 2].alpha;
       current += current;
     }
   }
-  queue->queue[current].p = moved.p;
-  queue->queue[current].q = moved.q;
+  queue->queue[current].pixel = moved.pixel;
   queue->queue[current].alpha = moved.alpha;
 }
 
@@ -73,31 +73,38 @@ void EdgeQueuePop(EdgeQueue *queue)
  * The edge that is added is inserted into the queue so that all its children have 
  * larger alpha values.
  * 
+ * The queue storage grows in chunks when it is full.
+ * 
  * @param queue EdgeQueue into which to add the edge
- * @param p 
- * @param q 
+ * @param p Index of the first pixel of the edge
+ * @param direction EDGE_X, EDGE_Y or EDGE_Z, direction of the second pixel
  * @param alpha Alphs value of the edge
  */
-void EdgeQueuePush(EdgeQueue *queue, int p, int q, double alpha)
+void EdgeQueuePush(EdgeQueue *queue, Index p, int direction, double alpha)
 {
   long current;
+  float key = (float)alpha;
   
+  if (queue->size == queue->maxsize)
+  {
+    // the queue is full, make room for at least another chunk of edges
+    queue->maxsize += MAX(EDGE_QUEUE_CHUNK, queue->maxsize / 2);
+    queue->queue = LargeRealloc(queue->queue, (queue->maxsize + 1) * sizeof(Edge));
+  }
   // increase the amount of elements in the queue and update where
   // the queue points to
   queue->size++;
   current = queue->size;
 
   // while we do not look at the root and the parents alpha is higer than the given alpha
-  while ((current / 2 != 0) && (queue->queue[current / 2].alpha > alpha))
+  while ((current / 2 != 0) && (queue->queue[current / 2].alpha > key))
   {
     // swap the parent to the current node
-    queue->queue[current].p = queue->queue[current / 2].p;
-    queue->queue[current].q = queue->queue[current / 2].q;
+    queue->queue[current].pixel = queue->queue[current / 2].pixel;
     queue->queue[current].alpha = queue->queue[current / 2].alpha;
     current = current / 2;
   }
   // set lastly swapped parent to the given value
-  queue->queue[current].p = p;
-  queue->queue[current].q = q;
-  queue->queue[current].alpha = alpha;
+  queue->queue[current].pixel = EdgeEncode(p, direction);
+  queue->queue[current].alpha = key;
 }
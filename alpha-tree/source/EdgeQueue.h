@@ -1,26 +1,45 @@
 #ifndef EDGE_QUEUE_H
 #define EDGE_QUEUE_H
 
-// Edge representation where p, q are indices of two pixels and alpha is the alpha value between them
+#include "../util/common.h"
+
+// The second pixel of an edge is always the left, upper or (in a volume) previous
+// slice neighbour of the first pixel, so an edge only stores the first pixel and
+// the direction to the second one
+#define EDGE_X 0 /* edge between p and p - 1 */
+#define EDGE_Y 1 /* edge between p and p - width */
+#define EDGE_Z 2 /* edge between p and p - width * height */
+
+// Number of edges the queue grows by (at least) once it is full
+#define EDGE_QUEUE_CHUNK (1 << 16)
+
+// Edge representation where pixel holds the index of the first pixel shifted left by two
+// and the direction in the lowest two bits, and alpha is the alpha value between the two pixels
 typedef struct Edge
 {
-  int p, q;
-  double alpha;
+  UIndex pixel;
+  float alpha;
 } Edge;
 
 // queue of edges
 typedef struct
 {
-  int size, maxsize;
+  Index size, maxsize;
   Edge *queue;
 } EdgeQueue;
 
 #define EdgeQueueFront(queue) (queue->queue + 1)
 #define IsEmpty(queue) ((queue->size) == 0)
 
+#define EdgeEncode(p, direction) (((UIndex)(p) << 2) | (direction))
+#define EdgePixel(edge) ((Index)((edge)->pixel >> 2))
+#define EdgeDirection(edge) ((int)((edge)->pixel & 3))
+#define EdgeNeighbour(edge, width, height) \
+  (EdgePixel(edge) - (EdgeDirection(edge) == EDGE_X ? 1 : EdgeDirection(edge) == EDGE_Y ? (width) : (Index)(width) * (height)))
+
 EdgeQueue *EdgeQueueCreate(long maxsize);
 void EdgeQueueDelete(EdgeQueue *oldqueue);
 void EdgeQueuePop(EdgeQueue *queue);
-void EdgeQueuePush(EdgeQueue *queue, int p, int q, double alpha);
+void EdgeQueuePush(EdgeQueue *queue, Index p, int direction, double alpha);
 
 #endif
\ No newline at end of file
@@ -1,42 +1,179 @@
 #include "SalienceTree.h"
 #include "../util/EdgeDetection.h"
+#include "../util/PageAlloc.h"
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+
+// Number of edges Phase2 takes from the queue ahead of processing them
+#define PHASE2_LOOKAHEAD 16
+
+// Bins of the edge strength histogram: the sign, exponent and 6 mantissa bits of
+// the strength as a double, which keeps the bins within 2% of their strength
+#define STRENGTH_SHIFT 46
+#define STRENGTH_BINS (1 << (64 - STRENGTH_SHIFT - 1))
 
 /**
  * @brief Create a Salience Tree object
  * 
- * @param imgsize Size of the image
+ * @param width Width of the image
+ * @param height Height of the image, the height times the depth for a volume
  * @return SalienceTree* Newly created Salience Tree
  */
-SalienceTree *CreateSalienceTree(int imgsize)
+SalienceTree *CreateSalienceTree(int width, int height)
 {
+  Index imgsize = (Index)width * height;
   SalienceTree *tree = malloc(sizeof(SalienceTree));
+  tree->width = width;
+  tree->firstRow = 0;
+  tree->lambdamin = 0;
+  tree->imgSize = imgsize;
   tree->maxSize = 2 * imgsize; /* potentially twice the number of nodes as pixels exist*/
   tree->curSize = imgsize;     /* first imgsize taken up by pixels */
-  tree->node = malloc((tree->maxSize) * sizeof(SalienceNode));
+  tree->node = LargeAlloc((size_t)tree->maxSize * sizeof(SalienceNode));
   return tree;
 }
 
+/**
+ * @brief Finds the lowest lambdamin, not below the given one, for which at most
+ * maxEdges edges have a strength of at least lambdamin, with one pass over the
+ * image that builds a histogram of the edge strengths. Non-negative doubles
+ * compare like their bit patterns, so the lower bound of every bin is a
+ * threshold of which the number of edges above it is known exactly.
+ *
+ * @param img Image we are working on
+ * @param width of the image
+ * @param height of the image
+ * @param lambdamin Lowest lambdamin to use
+ * @param maxEdges Largest number of edges Phase1 may push
+ * @param edgeCount Set to the number of edges at or above the returned lambdamin
+ * @return double The lambdamin
+ */
+static double ChooseLambdamin(Pixel *img, int width, int height, double lambdamin, long maxEdges, long *edgeCount)
+{
+  Index *histogram = calloc(STRENGTH_BINS, sizeof(Index));
+  unsigned long long bits;
+  double edgeSalience;
+  long above = 0, count = 0;
+  int x, y, bin, direction;
+
+  if (histogram == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  // the same edges as Phase1
+  for (y = 0; y < height; y++)
+  {
+    for (x = 0; x < width; x++)
+    {
+      for (direction = EDGE_X; direction <= EDGE_Y; direction++)
+      {
+        if (direction == EDGE_X ? x == 0 : y == 0)
+          continue;
+        edgeSalience = direction == EDGE_X ? EdgeStrengthX(img, width, height, x, y)
+                                           : EdgeStrengthY(img, width, height, x, y);
+        memcpy(&bits, &edgeSalience, sizeof(double));
+        histogram[bits >> STRENGTH_SHIFT]++;
+        if (edgeSalience >= lambdamin)
+          above++;
+      }
+    }
+  }
+  *edgeCount = above;
+  if (above > maxEdges)
+  {
+    // add up the bins from the strongest edges down while they fit
+    for (bin = STRENGTH_BINS; bin > 0 && count + histogram[bin - 1] <= maxEdges; bin--)
+      count += histogram[bin - 1];
+    if (bin == STRENGTH_BINS)
+    {
+      lambdamin = HUGE_VAL;
+    }
+    else
+    {
+      bits = (unsigned long long)bin << STRENGTH_SHIFT;
+      memcpy(&lambdamin, &bits, sizeof(double));
+    }
+    *edgeCount = count;
+  }
+  free(histogram);
+  return (lambdamin);
+}
+
+/**
+ * @brief Builds the salience tree of an image with Phase1 and Phase2.
+ *
+ * @param img Image we are working on
+ * @param width of the image
+ * @param height of the image
+ * @param lambdamin Edges below lambdamin are merged in Phase1
+ * @return SalienceTree* The tree, NULL on failure
+ */
 SalienceTree *MakeSalienceTree(Pixel *img, int width, int height, double lambdamin)
 {
-  int imgsize = width * height;
-  EdgeQueue *queue = EdgeQueueCreate((CONNECTIVITY / 2) * imgsize);
+  Index imgsize = (Index)width * height;
+  long edgeCount;
+  EdgeQueue *queue;
   // TODO what does the root array represent?
-  int *root = malloc(imgsize * 2 * sizeof(int));
+  Index *root = LargeAlloc((size_t)imgsize * 2 * sizeof(Index));
   SalienceTree *tree;
-  tree = CreateSalienceTree(imgsize);
+  PageCounters counters;
+
+  if (maxQueueEdges > 0)
+  {
+    // with a budget lambdamin is raised until the edges fit and the queue is sized
+    // for exactly those edges, only merges rejected by omega can make it grow.
+    // No edges are left when lambdamin became infinite, the rejected merges
+    // still need room.
+    lambdamin = ChooseLambdamin(img, width, height, lambdamin, maxQueueEdges, &edgeCount);
+    queue = EdgeQueueCreate(MAX(edgeCount, MIN(EDGE_QUEUE_CHUNK, maxQueueEdges)));
+  }
+  else
+  {
+    // the queue only grows as far as the number of edges above lambdamin requires
+    queue = EdgeQueueCreate(MIN(EDGE_QUEUE_CHUNK, (CONNECTIVITY / 2) * imgsize));
+  }
+  tree = CreateSalienceTree(width, height);
   assert(tree != NULL);
   assert(tree->node != NULL);
-  fprintf(stderr, "Phase1 started\n");
+  tree->lambdamin = lambdamin;
+  if (pageStats)
+    PageCountersStart(&counters);
+  Progress("Phase1 started\n");
   // Phase 1 combines nodes that are not seen as edges and fills the edge queue with found edges
-  Phase1(tree, queue, root, img, width, height, lambdamin);
-  fprintf(stderr, "Phase2 started\n");
+  if (!scanlinePhase1)
+    Phase1(tree, queue, root, img, width, height, lambdamin);
+  else if (!Phase1RunLength(tree, queue, root, img, width, height, lambdamin))
+  {
+    if (pageStats)
+      PageCountersReport("Phase1", &counters);
+    EdgeQueueDelete(queue);
+    LargeFree(root);
+    DeleteTree(tree);
+    return (NULL);
+  }
+  Progress("Phase2 started\n");
   // Phase 2 runs over all edges, creates SalienceNodes and 
   Phase2(tree, queue, root, img, width, height);
-  fprintf(stderr, "Phase2 done\n");
+  Progress("Phase2 done\n");
+  if (pageStats)
+    PageCountersReport("Phase1 and Phase2", &counters);
+  if (hugePages != HUGE_PAGES_NONE)
+  {
+    LargeAllocReport("node array", tree->node);
+    LargeAllocReport("root array", root);
+    LargeAllocReport("edge queue", queue->queue);
+  }
+  if (alphaStep > 0)
+    Progress("Quantized tree has %ld nodes\n", (long)tree->curSize);
+#ifdef ATTRIBUTE_PERIMETER
+  ComputePerimeters(tree, CONNECTIVITY);
+#endif
   EdgeQueueDelete(queue);
-  free(root);
+  LargeFree(root);
   return tree;
 }
 
@@ -47,34 +184,71 @@ SalienceTree *MakeSalienceTree(Pixel *img, int width, int height, double lambdam
  */
 void DeleteTree(SalienceTree *tree)
 {
-  free(tree->node);
+  LargeFree(tree->node);
   free(tree);
 }
 
 
+/**
+ * @brief Sets the attributes of a node to those of a node without pixels, so that
+ * the pixels of its children can be added with Union2.
+ * 
+ * @param node Node to clear
+ */
+static void ClearAttributes(SalienceNode *node)
+{
+  int i;
+
+#ifdef ATTRIBUTE_AREA
+  node->area = 0;
+#endif
+#ifdef ATTRIBUTE_BBOX
+  node->xmin = node->ymin = INT_MAX;
+  node->xmax = node->ymax = INT_MIN;
+#endif
+#ifdef ATTRIBUTE_MOMENTS
+  node->sumX = node->sumY = 0;
+  node->sumXX = node->sumXY = node->sumYY = 0;
+#endif
+#ifdef ATTRIBUTE_PERIMETER
+  node->perimeter = 0;
+#endif
+  for (i = 0; i < CHANNELS; i++)
+  {
+#ifdef ATTRIBUTE_MEAN
+    node->sumPix[i] = 0;
+#endif
+#ifdef ATTRIBUTE_RANGE
+    node->minPix[i] = CHANNEL_MAX;
+    node->maxPix[i] = 0;
+#endif
+  }
+}
+
 /**
  * @brief Create a Salience Node object in a given tree
  * 
  * @param tree Tree to which the node will be added
  * @param root 
  * @param alpha The nodes alpha level
- * @return int Index of the new node
+ * @return Index Index of the new node
  */
-int NewSalienceNode(SalienceTree *tree, int *root, double alpha)
+Index NewSalienceNode(SalienceTree *tree, Index *root, double alpha)
 {
   // node is the next free spot in the tree (pointer arithmetics)
   SalienceNode *node = tree->node + tree->curSize;
-  int result = tree->curSize;
+  Index result = tree->curSize;
   tree->curSize++;
   node->alpha = alpha;
   node->parent = BOTTOM;
+  ClearAttributes(node);
   root[result] = BOTTOM;
   return result;
 }
 
-int FindRoot(int *root, int p)
+Index FindRoot(Index *root, Index p)
 {
-  int r = p, i, j;
+  Index r = p, i, j;
 
   while (root[r] != BOTTOM)
   {
@@ -90,9 +264,9 @@ int FindRoot(int *root, int p)
   return r;
 }
 
-int FindRoot1(SalienceTree *tree, int *root, int p)
+Index FindRoot1(SalienceTree *tree, Index *root, Index p)
 {
-  int r, i, j;
+  Index r, i, j;
   r = p;
 
   // make r the root of the tree
@@ -124,11 +298,11 @@ int FindRoot1(SalienceTree *tree, int *root, int p)
  * 
  * @param tree Tree to search
  * @param p Node to find the level root of
- * @return int Index of the level root
+ * @return Index Index of the level root
  */
-int LevelRoot(SalienceTree *tree, int p)
+Index LevelRoot(SalienceTree *tree, Index p)
 {
-  int r = p, i, j;
+  Index r = p, i, j;
 
   while (!IsLevelRoot(tree, r))
   {
@@ -155,9 +329,9 @@ int LevelRoot(SalienceTree *tree, int p)
  * @return true if the node is at root level
  * @return false if the node is not at root level
  */
-boolean IsLevelRoot(SalienceTree *tree, int i)
+boolean IsLevelRoot(SalienceTree *tree, Index i)
 {
-  int parent = tree->node[i].parent;
+  Index parent = tree->node[i].parent;
 
   if (parent == BOTTOM)
     return true;
@@ -173,24 +347,61 @@ boolean IsLevelRoot(SalienceTree *tree, int i)
  * @param gval Array of pixels in the original image
  * @param p Index of the node in the tree
  */
-void MakeSet(SalienceTree *tree, int *root, Pixel *gval, int p)
+void MakeSet(SalienceTree *tree, Index *root, Pixel *gval, Index p)
+{
+  MakeSetPixel(tree, root, gval[p], p);
+}
+
+/**
+ * @brief Same as MakeSet for a pixel value that is not stored at index p of
+ * an image, e.g. a voxel of a slice of a volume.
+ * 
+ * @param tree Tree of the node
+ * @param root 
+ * @param value Value of the pixel
+ * @param p Index of the node in the tree
+ */
+void MakeSetPixel(SalienceTree *tree, Index *root, Pixel value, Index p)
 {
   int i;
+#if defined(ATTRIBUTE_BBOX) || defined(ATTRIBUTE_MOMENTS)
+  int x = p % tree->width, y = p / tree->width + tree->firstRow;
+#endif
   tree->node[p].parent = BOTTOM;
   root[p] = BOTTOM;
   tree->node[p].alpha = 0.0;
+#ifdef ATTRIBUTE_AREA
   tree->node[p].area = 1;
-  for (i = 0; i < 3; i++)
+#endif
+#ifdef ATTRIBUTE_BBOX
+  tree->node[p].xmin = tree->node[p].xmax = x;
+  tree->node[p].ymin = tree->node[p].ymax = y;
+#endif
+#ifdef ATTRIBUTE_MOMENTS
+  tree->node[p].sumX = x;
+  tree->node[p].sumY = y;
+  tree->node[p].sumXX = (double)x * x;
+  tree->node[p].sumXY = (double)x * y;
+  tree->node[p].sumYY = (double)y * y;
+#endif
+#ifdef ATTRIBUTE_PERIMETER
+  tree->node[p].perimeter = 0;
+#endif
+  for (i = 0; i < CHANNELS; i++)
   {
-    tree->node[p].sumPix[i] = gval[p][i];
-    tree->node[p].minPix[i] = gval[p][i];
-    tree->node[p].maxPix[i] = gval[p][i];
+#ifdef ATTRIBUTE_MEAN
+    tree->node[p].sumPix[i] = value[i];
+#endif
+#ifdef ATTRIBUTE_RANGE
+    tree->node[p].minPix[i] = value[i];
+    tree->node[p].maxPix[i] = value[i];
+#endif
   }
 }
 
-void GetAncestors(SalienceTree *tree, int *root, int *p, int *q)
+void GetAncestors(SalienceTree *tree, Index *root, Index *p, Index *q)
 {
-  int temp;
+  Index temp;
   // get root of each pixel and ensure correct order
   *p = LevelRoot(tree, *p);
   *q = LevelRoot(tree, *q);
@@ -223,49 +434,107 @@ void GetAncestors(SalienceTree *tree, int *root, int *p, int *q)
 }
 
 /**
- * @brief Combines the regions of two pixels.
+ * @brief Checks if merging two components would make the range of the merged
+ * component, the largest difference between its pixels in any channel,
+ * exceed omega. Only the minPix and maxPix of both components are needed,
+ * builds without the RANGE attribute never exceed omega.
+ * 
+ * @param tree Tree to work on
+ * @param p Root of the first component
+ * @param q Root of the second component
+ * @return true if the merge violates the omega constraint
+ */
+boolean ExceedsOmega(SalienceTree *tree, Index p, Index q)
+{
+#ifdef ATTRIBUTE_RANGE
+  int i;
+
+  for (i = 0; i < CHANNELS; i++)
+  {
+    if (MAX(tree->node[p].maxPix[i], tree->node[q].maxPix[i]) -
+            MIN(tree->node[p].minPix[i], tree->node[q].minPix[i]) >
+        omegafactor)
+      return true;
+  }
+#endif
+  return false;
+}
+
+/**
+ * @brief Adds the attributes of node q to those of node p. Only the attributes
+ * selected for the build are updated.
+ * 
+ * @param tree Tree to work on
+ * @param p Node that becomes the parent
+ * @param q Node that becomes the child
+ */
+static void MergeAttributes(SalienceTree *tree, Index p, Index q)
+{
+  int i;
+
+#ifdef ATTRIBUTE_AREA
+  tree->node[p].area += tree->node[q].area;
+#endif
+#ifdef ATTRIBUTE_BBOX
+  tree->node[p].xmin = MIN(tree->node[p].xmin, tree->node[q].xmin);
+  tree->node[p].xmax = MAX(tree->node[p].xmax, tree->node[q].xmax);
+  tree->node[p].ymin = MIN(tree->node[p].ymin, tree->node[q].ymin);
+  tree->node[p].ymax = MAX(tree->node[p].ymax, tree->node[q].ymax);
+#endif
+#ifdef ATTRIBUTE_MOMENTS
+  tree->node[p].sumX += tree->node[q].sumX;
+  tree->node[p].sumY += tree->node[q].sumY;
+  tree->node[p].sumXX += tree->node[q].sumXX;
+  tree->node[p].sumXY += tree->node[q].sumXY;
+  tree->node[p].sumYY += tree->node[q].sumYY;
+#endif
+  for (i = 0; i < CHANNELS; i++)
+  {
+#ifdef ATTRIBUTE_MEAN
+    tree->node[p].sumPix[i] += tree->node[q].sumPix[i];
+#endif
+#ifdef ATTRIBUTE_RANGE
+    tree->node[p].minPix[i] = MIN(tree->node[p].minPix[i], tree->node[q].minPix[i]);
+    tree->node[p].maxPix[i] = MAX(tree->node[p].maxPix[i], tree->node[q].maxPix[i]);
+#endif
+  }
+}
+
+/**
+ * @brief Combines the regions of two pixels, unless the combined region
+ * would exceed omega.
  * 
  * @param tree Tree to work on
  * @param root 
  * @param p First Pixel
  * @param q Second Pixel
+ * @return false if the regions were not combined because of omega
  */
-void Union(SalienceTree *tree, int *root, int p, int q)
+boolean Union(SalienceTree *tree, Index *root, Index p, Index q)
 { /* p is always current pixel */
-  int i;
-
   q = FindRoot1(tree, root, q);
 
   // if q's parent is not p
   if (q != p)
   {
+    if (ExceedsOmega(tree, p, q))
+      return false;
     // set p to be q's parent
     tree->node[q].parent = p;
     root[q] = p;
-    // increase the area as p now has more pixels as children
-    tree->node[p].area += tree->node[q].area;
-    // update total pixel sum, minimum pixel and maximum pixel values
-    for (i = 0; i < 3; i++)
-    {
-      tree->node[p].sumPix[i] += tree->node[q].sumPix[i];
-      tree->node[p].minPix[i] = MIN(tree->node[p].minPix[i], tree->node[q].minPix[i]);
-      tree->node[p].maxPix[i] = MAX(tree->node[p].maxPix[i], tree->node[q].maxPix[i]);
-    }
+    // p now has more pixels as children, update its area, pixel sum,
+    // minimum pixel and maximum pixel values
+    MergeAttributes(tree, p, q);
   }
+  InnerEdge(tree, p);
+  return true;
 }
 
-void Union2(SalienceTree *tree, int *root, int p, int q)
+void Union2(SalienceTree *tree, Index *root, Index p, Index q)
 {
-  int i;
   tree->node[q].parent = p;
   root[q] = p;
-  tree->node[p].area += tree->node[q].area;
-  for (i = 0; i < 3; i++)
-  {
-    tree->node[p].sumPix[i] += tree->node[q].sumPix[i];
-    tree->node[p].minPix[i] = MIN(tree->node[p].minPix[i], tree->node[q].minPix[i]);
-    tree->node[p].maxPix[i] = MAX(tree->node[p].maxPix[i], tree->node[q].maxPix[i]);
-  }
+  MergeAttributes(tree, p, q);
 }
 
 /**
@@ -282,14 +551,15 @@ void Union2(SalienceTree *tree, int *root, int p, int q)
  * @param height of the image
  * @param lambdamin threshold to determine if we have encountered an edge
  */
-void Phase1(SalienceTree *tree, EdgeQueue *queue, int *root, Pixel *img, int width, int height, double lambdamin)
+void Phase1(SalienceTree *tree, EdgeQueue *queue, Index *root, Pixel *img, int width, int height, double lambdamin)
 {
   // TODO make the EdgeStrength functions replaceable so that we can use different dissimilarity measures
   /* pre: tree has been created with imgsize= width*height
           queue initialized accordingly;
    */
-  int imgsize = width * height;
-  int p, x, y;
+  Index imgsize = (Index)width * height;
+  Index p;
+  int x, y;
   double edgeSalience;
 
   // root is a separate case
@@ -301,37 +571,25 @@ void Phase1(SalienceTree *tree, EdgeQueue *queue, int *root, Pixel *img, int wid
     // ready current node and find edge strength of the current position
     MakeSet(tree, root, img, x);
     edgeSalience = EdgeStrengthX(img, width, height, x, 0);
-    if (edgeSalience < lambdamin)
-    {
-      // if we evaluate as no edge then we combine the current and last pixel
-      Union(tree, root, x, x - 1);
-    }
-    else
-    {
-      // otherwise we store the found edge
-      EdgeQueuePush(queue, x, x - 1, edgeSalience);
-    }
+    // if we evaluate as no edge then we combine the current and last pixel,
+    // otherwise (or if their combined range exceeds omega) we store the found edge
+    if (edgeSalience >= lambdamin || !Union(tree, root, x, x - 1))
+      EdgeQueuePush(queue, x, EDGE_X, edgeSalience);
   }
 
   // for all other rows
   for (y = 1; y < height; y++)
   {
     // p is the first pixel in the row
-    p = y * width;
+    p = (Index)y * width;
     // ready current node and find edge strength of the current position
     MakeSet(tree, root, img, p);
     edgeSalience = EdgeStrengthY(img, width, height, 0, y);
 
-    if (edgeSalience < lambdamin)
-    {
-      // if we evaluate as no edge then we combine the current and last pixel
-      Union(tree, root, p, p - width);
-    }
-    else
-    {
-      // otherwise we store the found edge
-      EdgeQueuePush(queue, p, p - width, edgeSalience);
-    }
+    // if we evaluate as no edge then we combine the current and last pixel,
+    // otherwise (or if their combined range exceeds omega) we store the found edge
+    if (edgeSalience >= lambdamin || !Union(tree, root, p, p - width))
+      EdgeQueuePush(queue, p, EDGE_Y, edgeSalience);
     p++;
     // for each column in the current row
     for (x = 1; x < width; x++, p++)
@@ -339,67 +597,636 @@ void Phase1(SalienceTree *tree, EdgeQueue *queue, int *root, Pixel *img, int wid
       // reapeat process in y-direction
       MakeSet(tree, root, img, p);
       edgeSalience = EdgeStrengthY(img, width, height, x, y);
-      if (edgeSalience < lambdamin)
+      if (edgeSalience >= lambdamin || !Union(tree, root, p, p - width))
+        EdgeQueuePush(queue, p, EDGE_Y, edgeSalience);
+      // repeat process in x-direction
+      edgeSalience = EdgeStrengthX(img, width, height, x, y);
+      if (edgeSalience >= lambdamin || !Union(tree, root, p, p - 1))
+        EdgeQueuePush(queue, p, EDGE_X, edgeSalience);
+    }
+  }
+}
+
+/**
+ * @brief Same flat zones as Phase1 without an omega constraint, but formed row by
+ * row. Pixels of a row that are not separated by an edge form a run that is merged
+ * as a block, after which the runs are joined to the runs of the row above. With
+ * an active omega the joins are tried in another order than in Phase1, so omega
+ * can refuse other joins and the flat zones and the queued edges can differ;
+ * every refused edge is still pushed to the queue. These joins use the area
+ * of the components (in builds with the AREA attribute) to decide which root becomes the parent, which keeps the root
+ * chains short on images with large flat regions. Afterwards every pixel is made a
+ * direct child of the pixel with the highest index in its flat zone, exactly like
+ * Phase1 leaves them.
+ * 
+ * @param tree Salience Tree we are working on
+ * @param queue Edge queue to push to
+ * @param root 
+ * @param img Image we are working on
+ * @param width of the image
+ * @param height of the image
+ * @param lambdamin threshold to determine if we have encountered an edge
+ * @return boolean false if there is no memory for the runs
+ */
+boolean Phase1RunLength(SalienceTree *tree, EdgeQueue *queue, Index *root, Pixel *img, int width, int height, double lambdamin)
+{
+  /* pre: tree has been created with imgsize= width*height
+          queue initialized accordingly;
+          root has room for 2*imgsize entries
+   */
+  Index imgsize = (Index)width * height;
+  // the second half of root is not used before Phase2, it holds the highest
+  // pixel index of every component at the root of that component
+  Index *top = root + imgsize;
+  // which pixels are in the same run as their left neighbour, for this and the previous row
+  boolean *joined = malloc(2 * width * sizeof(boolean));
+  // columns of the current row that have to be joined with the row above
+  int *links = malloc(width * sizeof(int));
+  boolean *current, *previous;
+  Index p, q, head;
+  int x, y, i, linkCount;
+  double edgeSalience;
+  // whether the pixels of the previous link ended up in the same component
+  boolean linked = false;
+
+  if (joined == NULL || links == NULL)
+  {
+    fprintf(stderr, "Error: Not enough memory for the runs of Phase1!");
+    free(links);
+    free(joined);
+    return (false);
+  }
+  for (y = 0; y < height; y++)
+  {
+    current = joined + (y % 2) * width;
+    previous = joined + ((y + 1) % 2) * width;
+    linkCount = 0;
+    // the first pixel of a row always starts a new run
+    p = (Index)y * width;
+    head = p;
+    current[0] = false;
+    for (x = 0; x < width; x++, p++)
+    {
+      MakeSet(tree, root, img, p);
+      if (y > 0)
       {
-        Union(tree, root, p, p - width);
+        edgeSalience = EdgeStrengthY(img, width, height, x, y);
+        if (edgeSalience < lambdamin)
+          links[linkCount++] = x;
+        else
+          EdgeQueuePush(queue, p, EDGE_Y, edgeSalience);
       }
-      else
+      if (x > 0)
       {
-        EdgeQueuePush(queue, p, p - width, edgeSalience);
+        edgeSalience = EdgeStrengthX(img, width, height, x, y);
+        current[x] = (edgeSalience < lambdamin && !ExceedsOmega(tree, head, p));
+        if (current[x])
+        {
+          // extend the run, all its pixels hang directly below its first pixel
+          Union2(tree, root, head, p);
+          InnerEdge(tree, head);
+        }
+        else
+        {
+          EdgeQueuePush(queue, p, EDGE_X, edgeSalience);
+          top[head] = p - 1;
+          head = p;
+        }
       }
-      // repeat process in x-direction
-      edgeSalience = EdgeStrengthX(img, width, height, x, y);
-      if (edgeSalience < lambdamin)
+    }
+    top[head] = p - 1;
+
+    // join the runs of this row with the runs of the row above
+    for (i = 0; i < linkCount; i++)
+    {
+      x = links[i];
+      // nothing to do if the left neighbours are in the same component and both
+      // pixels are in the same run as them, a link refused by omega does not count
+      if (i > 0 && links[i - 1] == x - 1 && linked && current[x] && previous[x])
+      {
+#ifdef ATTRIBUTE_PERIMETER
+        InnerEdge(tree, FindRoot(root, (Index)y * width + x));
+#endif
+        continue;
+      }
+      p = FindRoot(root, (Index)y * width + x);
+      q = FindRoot(root, (Index)(y - 1) * width + x);
+      if (p != q && ExceedsOmega(tree, p, q))
       {
-        Union(tree, root, p, p - 1);
+        // the runs stay apart, Phase2 joins them at the omega level
+        EdgeQueuePush(queue, (Index)y * width + x, EDGE_Y, EdgeStrengthY(img, width, height, x, y));
+        linked = false;
+        continue;
+      }
+      else if (p != q)
+      {
+#ifdef ATTRIBUTE_AREA
+        // the larger component becomes the parent
+        if (tree->node[p].area < tree->node[q].area)
+        {
+          head = p;
+          p = q;
+          q = head;
+        }
+#endif
+        Union2(tree, root, p, q);
+        InnerEdge(tree, p);
+        top[p] = MAX(top[p], top[q]);
       }
       else
       {
-        EdgeQueuePush(queue, p, p - 1, edgeSalience);
+        InnerEdge(tree, p);
       }
+      linked = true;
     }
   }
+
+  // move the attributes of every component to its pixel with the highest index
+  for (p = 0; p < imgsize; p++)
+  {
+    q = FindRoot(root, p);
+    if (p == q && top[q] != q)
+    {
+#ifdef ATTRIBUTE_PERIMETER
+      // the edges counted in either pixel belong to the flat zone
+      tree->node[q].perimeter += tree->node[top[q]].perimeter;
+#endif
+      tree->node[top[q]] = tree->node[q];
+#ifdef ATTRIBUTE_PERIMETER
+      tree->node[q].perimeter = 0;
+#endif
+    }
+    tree->node[p].parent = top[q];
+  }
+  // and let every other pixel point straight at it
+  for (p = 0; p < imgsize; p++)
+  {
+    if (tree->node[p].parent == p)
+      tree->node[p].parent = BOTTOM;
+    root[p] = tree->node[p].parent;
+  }
+  free(links);
+  free(joined);
+  return (true);
 }
 
-void Phase2(SalienceTree *tree, EdgeQueue *queue, int *root, Pixel *img, int width, int height)
+/**
+ * @brief Issues prefetches for the pixel nodes and root entries of an edge.
+ */
+static void PrefetchEdge(SalienceTree *tree, Index *root, Edge *edge, int width, int height)
+{
+  Index p = EdgePixel(edge), q = EdgeNeighbour(edge, width, height);
+
+  __builtin_prefetch(tree->node + p);
+  __builtin_prefetch(tree->node + q);
+  __builtin_prefetch(root + p);
+  __builtin_prefetch(root + q);
+}
+
+/**
+ * @brief Issues prefetches for the parents of the pixels of an edge. The pixel
+ * nodes themselves should have been prefetched some time before.
+ */
+static void PrefetchAncestors(SalienceTree *tree, Index *root, Edge *edge, int width, int height)
+{
+  Index p = EdgePixel(edge), q = EdgeNeighbour(edge, width, height);
+
+  if (tree->node[p].parent != BOTTOM)
+    __builtin_prefetch(tree->node + tree->node[p].parent);
+  if (tree->node[q].parent != BOTTOM)
+    __builtin_prefetch(tree->node + tree->node[q].parent);
+  if (root[p] != BOTTOM)
+    __builtin_prefetch(root + root[p]);
+  if (root[q] != BOTTOM)
+    __builtin_prefetch(root + root[q]);
+}
+
+// Union-find forest over the pixels that joins components in the same order as
+// Phase2, with union by size and without path compression, so that it stays
+// O(log n) deep and remembers when two pixels were joined. link[p] is the node of
+// the tree in which the component of p was joined to that of up[p].
+typedef struct MeetForest
+{
+  Index *up;
+  Index *link;
+  Index *size;
+} MeetForest;
+
+/**
+ * @brief Sets up the forest for Phase2 with every flat zone as one component,
+ * joined in the pixel at its top. Only builds with the PERIMETER attribute need
+ * the forest, for all others it is not allocated.
+ */
+static void CreateMeetForest(SalienceTree *tree, MeetForest *forest)
+{
+#ifdef ATTRIBUTE_PERIMETER
+  Index p, r, imgsize = tree->imgSize;
+
+  forest->up = malloc(imgsize * sizeof(Index));
+  forest->link = malloc(imgsize * sizeof(Index));
+  forest->size = malloc(imgsize * sizeof(Index));
+  if (forest->up == NULL || forest->link == NULL || forest->size == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  // parents have higher indices, so going down every parent already knows its top
+  for (p = imgsize - 1; p >= 0; p--)
+  {
+    forest->size[p] = 1;
+    r = tree->node[p].parent;
+    if (r == BOTTOM)
+    {
+      forest->up[p] = BOTTOM;
+      continue;
+    }
+    if (forest->up[r] != BOTTOM)
+      r = forest->up[r];
+    forest->up[p] = forest->link[p] = r;
+    forest->size[r]++;
+  }
+#else
+  (void)tree;
+  forest->up = forest->link = forest->size = NULL;
+#endif
+}
+
+static void DeleteMeetForest(MeetForest *forest)
+{
+  free(forest->up);
+  free(forest->link);
+  free(forest->size);
+}
+
+#ifdef ATTRIBUTE_PERIMETER
+static int MeetDepth(MeetForest *forest, Index p)
+{
+  int depth = 0;
+
+  for (; forest->up[p] != BOTTOM; p = forest->up[p])
+    depth++;
+  return depth;
+}
+
+/**
+ * @brief Records that the components of pixels p and q were joined in node r.
+ */
+static void MeetUnion(MeetForest *forest, Index p, Index q, Index r)
+{
+  while (forest->up[p] != BOTTOM)
+    p = forest->up[p];
+  while (forest->up[q] != BOTTOM)
+    q = forest->up[q];
+  if (forest->size[p] < forest->size[q])
+  {
+    forest->up[p] = q;
+    forest->link[p] = r;
+    forest->size[q] += forest->size[p];
+  }
+  else
+  {
+    forest->up[q] = p;
+    forest->link[q] = r;
+    forest->size[p] += forest->size[q];
+  }
+}
+
+/**
+ * @brief Finds the lowest node that contains both of two pixels of the same
+ * component. The paths of p and q in the forest meet where their components were
+ * joined, of the two links below that point the later one, with the higher alpha,
+ * is the node in which p and q met. Nodes joined later with the same alpha are
+ * ancestors within the same level, which is all the perimeter needs.
+ * 
+ * @param tree Tree to work on
+ * @param forest Forest of the components
+ * @param p First pixel
+ * @param q Second pixel
+ * @return Index Node in which p and q met
+ */
+static Index MeetingNode(SalienceTree *tree, MeetForest *forest, Index p, Index q)
+{
+  int dp = MeetDepth(forest, p), dq = MeetDepth(forest, q);
+  Index lp = BOTTOM, lq = BOTTOM;
+
+  for (; dp > dq; dp--)
+  {
+    lp = forest->link[p];
+    p = forest->up[p];
+  }
+  for (; dq > dp; dq--)
+  {
+    lq = forest->link[q];
+    q = forest->up[q];
+  }
+  while (p != q)
+  {
+    lp = forest->link[p];
+    p = forest->up[p];
+    lq = forest->link[q];
+    q = forest->up[q];
+  }
+  if (lp == BOTTOM)
+    return lq;
+  if (lq == BOTTOM)
+    return lp;
+  return (tree->node[lp].alpha >= tree->node[lq].alpha ? lp : lq);
+}
+#endif
+
+/**
+ * @brief Adds an edge to the upper levels of the tree, the step Phase2 performs
+ * for every edge.
+ * 
+ * @param tree Salience Tree we are working on
+ * @param root 
+ * @param forest Components for finding where the pixels of an edge meet
+ * @param v1 First pixel of the edge
+ * @param v2 Second pixel of the edge
+ * @param alpha12 Alpha value of the edge
+ * @return Index Node that holds both pixels after the edge
+ */
+static Index Phase2Edge(SalienceTree *tree, Index *root, MeetForest *forest, Index v1, Index v2, double alpha12)
+{
+  Index temp, r;
+#ifdef ATTRIBUTE_PERIMETER
+  Index p = v1, q = v2;
+#else
+  (void)forest;
+#endif
+
+  // quantized alphas keep their order, so the edges still come in order
+  if (alphaStep > 0)
+    alpha12 = ceil(alpha12 / alphaStep) * alphaStep;
+  GetAncestors(tree, root, &v1, &v2);
+  if (v1 == v2)
+  {
+#ifdef ATTRIBUTE_PERIMETER
+    // the pixels already met below the root of their component
+    InnerEdge(tree, MeetingNode(tree, forest, p, q));
+#endif
+    return (v1);
+  }
+  else
+  {
+    if (v1 < v2)
+    {
+      temp = v1;
+      v1 = v2;
+      v2 = temp;
+    }
+    // a merge that makes the range of the component exceed omega is rejected,
+    // the two components only meet at the omega level above all other levels
+    if (ExceedsOmega(tree, v1, v2))
+      alpha12 = OMEGA_ALPHA;
+    if (tree->node[v1].alpha < alpha12)
+    {
+      // if the higher node has a lower alpha level than the edge
+      // we combine the two nodes in a new salience node
+      r = NewSalienceNode(tree, root, alpha12);
+      Union2(tree, root, r, v1);
+      Union2(tree, root, r, v2);
+    }
+    else
+    {
+      // otherwise we add the lower node to the higher node
+      Union2(tree, root, v1, v2);
+      r = v1;
+    }
+    InnerEdge(tree, r);
+#ifdef ATTRIBUTE_PERIMETER
+    MeetUnion(forest, p, q, r);
+#endif
+    return (r);
+  }
+}
+
+/**
+ * @brief Processes all edges in the queue in order of increasing alpha and builds
+ * the upper levels of the tree. Phase2 never pushes edges, so the next
+ * PHASE2_LOOKAHEAD edges are taken from the queue ahead of time. When an edge enters
+ * this window its pixels are prefetched, halfway through the window their parents
+ * are prefetched, so that the cache misses of several edges overlap instead of each
+ * edge stalling on its own.
+ * 
+ * @param tree Salience Tree we are working on
+ * @param queue Edge queue with the edges found by Phase1
+ * @param root 
+ * @param img Image we are working on
+ * @param width of the image
+ * @param height of the image
+ */
+void Phase2(SalienceTree *tree, EdgeQueue *queue, Index *root, Pixel *img, int width, int height)
 {
-  Edge *currentEdge;
-  int v1, v2, temp, r;
+  Edge window[PHASE2_LOOKAHEAD];
+  MeetForest forest;
+  Index v1, v2;
+  int current = 0, count = 0;
   double oldalpha, alpha12;
   oldalpha = 0;
-  while (!IsEmpty(queue))
+  CreateMeetForest(tree, &forest);
+  // fill the lookahead window
+  while (count < PHASE2_LOOKAHEAD && !IsEmpty(queue))
   {
-    // deque the current edge and temporarily store its values
-    currentEdge = EdgeQueueFront(queue);
-    v1 = currentEdge->p;
-    v2 = currentEdge->q;
-    GetAncestors(tree, root, &v1, &v2);
-    alpha12 = currentEdge->alpha;
-
+    window[count] = *EdgeQueueFront(queue);
     EdgeQueuePop(queue);
-    if (v1 != v2)
+    PrefetchEdge(tree, root, window + count, width, height);
+    count++;
+  }
+  while (count > 0)
+  {
+    // deque the current edge and temporarily store its values
+    v1 = EdgePixel(window + current);
+    v2 = EdgeNeighbour(window + current, width, height);
+    alpha12 = window[current].alpha;
+    // the freed slot becomes the end of the window
+    if (!IsEmpty(queue))
     {
-      if (v1 < v2)
-      {
-        temp = v1;
-        v1 = v2;
-        v2 = temp;
-      }
-      if (tree->node[v1].alpha < alpha12)
-      {
-        // if the higher node has a lower alpha level than the edge
-        // we combine the two nodes in a new salience node
-        r = NewSalienceNode(tree, root, alpha12);
-        Union2(tree, root, r, v1);
-        Union2(tree, root, r, v2);
-      }
-      else
-      {
-        // otherwise we add the lower node to the higher node
-        Union2(tree, root, v1, v2);
-      }
+      window[current] = *EdgeQueueFront(queue);
+      EdgeQueuePop(queue);
+      PrefetchEdge(tree, root, window + current, width, height);
+    }
+    else
+    {
+      count--;
     }
+    current = (current + 1) % PHASE2_LOOKAHEAD;
+    if (count > PHASE2_LOOKAHEAD / 2)
+      PrefetchAncestors(tree, root, window + (current + PHASE2_LOOKAHEAD / 2) % PHASE2_LOOKAHEAD, width, height);
+
+    Phase2Edge(tree, root, &forest, v1, v2, alpha12);
     // store last edge alpha
     oldalpha = alpha12;
   }
+  DeleteMeetForest(&forest);
+}
+
+/**
+ * @brief Same as Phase2 for edges that are already sorted by increasing alpha,
+ * which are processed without a queue.
+ * 
+ * @param tree Salience Tree we are working on
+ * @param edges Edges sorted by alpha
+ * @param count Number of edges
+ * @param root 
+ * @param width of the image
+ * @param height of the image
+ * @param meet Set to the node that holds both pixels of every edge, may be NULL
+ */
+void Phase2Sorted(SalienceTree *tree, Edge *edges, long count, Index *root, int width, int height, Index *meet)
+{
+  MeetForest forest;
+  Index r;
+  long i;
+
+  CreateMeetForest(tree, &forest);
+  for (i = 0; i < count; i++)
+  {
+    // the same prefetch distances as the lookahead window of Phase2
+    if (i + PHASE2_LOOKAHEAD < count)
+      PrefetchEdge(tree, root, edges + i + PHASE2_LOOKAHEAD, width, height);
+    if (i + PHASE2_LOOKAHEAD / 2 < count)
+      PrefetchAncestors(tree, root, edges + i + PHASE2_LOOKAHEAD / 2, width, height);
+    r = Phase2Edge(tree, root, &forest, EdgePixel(edges + i), EdgeNeighbour(edges + i, width, height), edges[i].alpha);
+    if (meet != NULL)
+      meet[i] = r;
+  }
+  DeleteMeetForest(&forest);
+}
+
+#ifdef ATTRIBUTE_PERIMETER
+/**
+ * @brief Turns the edges counted by InnerEdge into the perimeter of every node:
+ * the sides of all its pixels minus two for every edge between two of its pixels.
+ * Parents have higher indices than their children, so a single pass in index
+ * order adds up the edges of all descendants.
+ * 
+ * @param tree Tree to work on
+ * @param sides Number of sides of a pixel, CONNECTIVITY or 6 for a voxel
+ */
+void ComputePerimeters(SalienceTree *tree, int sides)
+{
+  Index i, parent;
+
+  for (i = 0; i < tree->curSize; i++)
+  {
+    parent = tree->node[i].parent;
+    if (parent != BOTTOM)
+      tree->node[parent].perimeter += tree->node[i].perimeter;
+    tree->node[i].perimeter = sides * tree->node[i].area - 2 * tree->node[i].perimeter;
+  }
+}
+#endif
+
+/**
+ * @brief Removes the internal nodes that are not level roots from a finished
+ * tree and numbers the remaining internal nodes in post order. Every filter
+ * skips the removed nodes anyway, their attributes are part of those of their
+ * level root. The post order keeps children below their parents, as all passes
+ * over the tree expect, and puts the nodes of every subtree next to each other
+ * in the array. The pixel nodes keep their indices. The nodes are moved in place
+ * along the cycles of the renumbering and the array is shrunk afterwards.
+ *
+ * @param tree Tree to compact, its parents point to level roots afterwards
+ * @return Index The number of nodes left
+ */
+Index CompactSalienceTree(SalienceTree *tree)
+{
+  Index imgsize = tree->imgSize, internal = tree->curSize - imgsize;
+  Index *number, *child, *sibling, *stack;
+  Index i, u, v, top = 0, count = imgsize;
+  SalienceNode carry, swap;
+
+  if (internal == 0)
+    return (tree->curSize);
+  number = malloc(internal * sizeof(Index));
+  child = malloc(internal * sizeof(Index));
+  sibling = malloc(internal * sizeof(Index));
+  stack = malloc(internal * sizeof(Index));
+  if (number == NULL || child == NULL || sibling == NULL || stack == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  // going down every parent already points to its level root, so each step is short
+  for (i = tree->curSize - 2; i >= 0; i--)
+    tree->node[i].parent = LevelRoot(tree, tree->node[i].parent);
+
+  for (i = 0; i < internal; i++)
+  {
+    child[i] = BOTTOM;
+    number[i] = BOTTOM;
+  }
+  // the lists of children are in index order, the root is always a level root
+  for (i = tree->curSize - 2; i >= imgsize; i--)
+  {
+    if (!IsLevelRoot(tree, i))
+      continue;
+    sibling[i - imgsize] = child[tree->node[i].parent - imgsize];
+    child[tree->node[i].parent - imgsize] = i;
+  }
+  stack[0] = tree->curSize - 1;
+  while (top >= 0)
+  {
+    u = stack[top];
+    if (child[u - imgsize] != BOTTOM)
+    {
+      v = child[u - imgsize];
+      child[u - imgsize] = sibling[v - imgsize];
+      stack[++top] = v;
+      continue;
+    }
+    top--;
+    number[u - imgsize] = count++;
+  }
+
+  // flat zones of Phase1 can have pixels as their level root
+  for (i = 0; i < tree->curSize; i++)
+    if (tree->node[i].parent >= imgsize)
+      tree->node[i].parent = number[tree->node[i].parent - imgsize];
+  // nodes that move out of the new range start chains that end in the slot of a
+  // removed node, the nodes that are left form cycles
+  for (i = count; i < tree->curSize; i++)
+  {
+    if (number[i - imgsize] == BOTTOM)
+      continue;
+    carry = tree->node[i];
+    u = number[i - imgsize];
+    while (number[u - imgsize] != BOTTOM)
+    {
+      swap = tree->node[u];
+      tree->node[u] = carry;
+      carry = swap;
+      v = number[u - imgsize];
+      number[u - imgsize] = BOTTOM;
+      u = v;
+    }
+    tree->node[u] = carry;
+  }
+  for (i = imgsize; i < count; i++)
+  {
+    if (number[i - imgsize] == BOTTOM || number[i - imgsize] == i)
+      continue;
+    carry = tree->node[i];
+    u = number[i - imgsize];
+    number[i - imgsize] = BOTTOM;
+    while (u != i)
+    {
+      swap = tree->node[u];
+      tree->node[u] = carry;
+      carry = swap;
+      v = number[u - imgsize];
+      number[u - imgsize] = BOTTOM;
+      u = v;
+    }
+    tree->node[i] = carry;
+  }
+
+  free(stack);
+  free(sibling);
+  free(child);
+  free(number);
+  tree->curSize = tree->maxSize = count;
+  tree->node = LargeRealloc(tree->node, (size_t)count * sizeof(SalienceNode));
+  return (count);
 }
@@ -3,42 +3,86 @@
 
 #include "../util/common.h"
 #include "EdgeQueue.h"
+#include <float.h>
 
 #define Par(tree, p) LevelRoot(tree, tree->node[p].parent)
 
+// alpha of the nodes that join components whose combined range exceeds omega
+#define OMEGA_ALPHA DBL_MAX
+
+// the attributes are only part of the nodes in builds that select them
 typedef struct SalienceNode
 {
-  int parent;
-  int area;
+  Index parent;
+#ifdef ATTRIBUTE_AREA
+  Index area;
+#endif
   boolean filtered; /* indicates whether or not the filtered value is OK */
+#ifdef ATTRIBUTE_MEAN
   Pixel outval;  /* output value after filtering */
+#endif
   double alpha;  /* alpha of flat zone */
-  double sumPix[3];
+#ifdef ATTRIBUTE_MEAN
+  double sumPix[CHANNELS];
+#endif
+#ifdef ATTRIBUTE_RANGE
   Pixel minPix;
   Pixel maxPix;
+#endif
+#ifdef ATTRIBUTE_BBOX
+  int xmin, xmax, ymin, ymax;
+#endif
+#ifdef ATTRIBUTE_MOMENTS
+  double sumX, sumY;            /* first order moments */
+  double sumXX, sumXY, sumYY;   /* second order moments */
+#endif
+#ifdef ATTRIBUTE_PERIMETER
+  Index perimeter; /* while building: edges of which the pixels meet in this node */
+#endif
 } SalienceNode;
 
 typedef struct SalienceTree
 {
-  int maxSize;
-  int curSize;
+  Index maxSize;
+  Index curSize;
+  Index imgSize; /* nodes 0 .. imgSize - 1 are the pixels, the internal nodes follow */
+  int width;     /* width of the image, pixel p is at (p % width, p / width + firstRow) */
+  int firstRow;  /* row of pixel 0, only non-zero for the partial tree of a tile */
+  double lambdamin; /* edges below it were merged by Phase1 */
   SalienceNode *node;
 } SalienceTree;
 
+// Counts an edge between two pixels of the component with root r, the two sides
+// of the pixels along the edge are not part of the perimeter of the component
+// and its ancestors, see ComputePerimeters
+#ifdef ATTRIBUTE_PERIMETER
+#define InnerEdge(tree, r) ((tree)->node[r].perimeter++)
+#else
+#define InnerEdge(tree, r)
+#endif
+
 
-SalienceTree *CreateSalienceTree(int imgsize);
+SalienceTree *CreateSalienceTree(int width, int height);
 SalienceTree *MakeSalienceTree(Pixel *img, int width, int height, double lambdamin);
 void DeleteTree(SalienceTree *tree);
-int NewSalienceNode(SalienceTree *tree, int *root, double alpha);
-int FindRoot(int *root, int p);
-int FindRoot1(SalienceTree *tree, int *root, int p);
-int LevelRoot(SalienceTree *tree, int p);
-boolean IsLevelRoot(SalienceTree *tree, int i);
-void MakeSet(SalienceTree *tree, int *root, Pixel *gval, int p);
-void GetAncestors(SalienceTree *tree, int *root, int *p, int *q);
-void Union(SalienceTree *tree, int *root, int p, int q);
-void Union2(SalienceTree *tree, int *root, int p, int q);
-void Phase1(SalienceTree *tree, EdgeQueue *queue, int *root, Pixel *img, int width, int height, double lambdamin);
-void Phase2(SalienceTree *tree, EdgeQueue *queue, int *root, Pixel *img, int width, int height);
+Index NewSalienceNode(SalienceTree *tree, Index *root, double alpha);
+Index FindRoot(Index *root, Index p);
+Index FindRoot1(SalienceTree *tree, Index *root, Index p);
+Index LevelRoot(SalienceTree *tree, Index p);
+boolean IsLevelRoot(SalienceTree *tree, Index i);
+void MakeSet(SalienceTree *tree, Index *root, Pixel *gval, Index p);
+void MakeSetPixel(SalienceTree *tree, Index *root, Pixel value, Index p);
+void GetAncestors(SalienceTree *tree, Index *root, Index *p, Index *q);
+boolean ExceedsOmega(SalienceTree *tree, Index p, Index q);
+boolean Union(SalienceTree *tree, Index *root, Index p, Index q);
+void Union2(SalienceTree *tree, Index *root, Index p, Index q);
+void Phase1(SalienceTree *tree, EdgeQueue *queue, Index *root, Pixel *img, int width, int height, double lambdamin);
+boolean Phase1RunLength(SalienceTree *tree, EdgeQueue *queue, Index *root, Pixel *img, int width, int height, double lambdamin);
+void Phase2(SalienceTree *tree, EdgeQueue *queue, Index *root, Pixel *img, int width, int height);
+void Phase2Sorted(SalienceTree *tree, Edge *edges, long count, Index *root, int width, int height, Index *meet);
+#ifdef ATTRIBUTE_PERIMETER
+void ComputePerimeters(SalienceTree *tree, int sides);
+#endif
+Index CompactSalienceTree(SalienceTree *tree);
 
 #endif
\ No newline at end of file
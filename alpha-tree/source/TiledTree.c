@@ -0,0 +1,416 @@
+#include "TiledTree.h"
+#include "../util/EdgeDetection.h"
+#include "../util/PPMImageReadWrite.h"
+#include "../util/PageAlloc.h"
+#include <stdlib.h>
+#include <assert.h>
+
+/**
+ * @brief Stores an edge in a plain array of edges.
+ *
+ * @param edges Array to store the edge in
+ * @param count Number of edges in the array, incremented by one
+ * @param p Global index of the first pixel
+ * @param direction EDGE_X or EDGE_Y, direction of the second pixel
+ * @param alpha Alpha value of the edge
+ */
+static void StoreEdge(Edge *edges, long *count, Index p, int direction, double alpha)
+{
+  edges[*count].pixel = EdgeEncode(p, direction);
+  edges[*count].alpha = (float)alpha;
+  (*count)++;
+}
+
+/**
+ * @brief Gives the TILE_ATTRIBUTE_* flags of the attributes of this build.
+ */
+static int TileAttributes(void)
+{
+  int attributes = 0;
+
+#ifdef ATTRIBUTE_AREA
+  attributes |= TILE_ATTRIBUTE_AREA;
+#endif
+#ifdef ATTRIBUTE_MEAN
+  attributes |= TILE_ATTRIBUTE_MEAN;
+#endif
+#ifdef ATTRIBUTE_RANGE
+  attributes |= TILE_ATTRIBUTE_RANGE;
+#endif
+#ifdef ATTRIBUTE_BBOX
+  attributes |= TILE_ATTRIBUTE_BBOX;
+#endif
+#ifdef ATTRIBUTE_MOMENTS
+  attributes |= TILE_ATTRIBUTE_MOMENTS;
+#endif
+#ifdef ATTRIBUTE_PERIMETER
+  attributes |= TILE_ATTRIBUTE_PERIMETER;
+#endif
+  return (attributes);
+}
+
+/**
+ * @brief Runs Phase1 on the rows [firstRow, lastRow) of an image and writes the
+ * resulting partial tree to a file. Only the rows of the tile and the rows directly
+ * above and below it are read, so that the edge strengths are identical to those of
+ * a build over the whole image. Edges below lambdamin between the first row of the
+ * tile and the row above it are stored as boundary edges for the merge step.
+ *
+ * @param imgfname Path to the binary (P6) ppm image
+ * @param lambdamin threshold to determine if we have encountered an edge
+ * @param firstRow First row of the tile
+ * @param lastRow Row after the last row of the tile
+ * @param partfname Path of the partial tree file to write
+ * @return int 1 on success, 0 on failure
+ */
+int BuildTile(char *imgfname, double lambdamin, int firstRow, int lastRow, char *partfname)
+{
+  TileHeader header;
+  SalienceTree *tree;
+  Pixel *window, *tile;
+  Edge *edges, *boundary;
+  Index *root;
+  Index tilesize, offset, p;
+  int imgwidth, imgheight, windowFirst, windowLast, windowHeight;
+  int x, y, wy;
+  double edgeSalience;
+  FILE *outfile;
+
+  // read the tile together with one extra row on each side
+  windowFirst = firstRow - 1;
+  windowLast = lastRow + 1;
+  window = ImagePPMBinReadRows(imgfname, &windowFirst, &windowLast, &imgwidth, &imgheight);
+  if (window == NULL)
+    return (0);
+  if (!ImageFitsIndex(imgwidth, imgheight))
+  {
+    free(window);
+    return (0);
+  }
+  if (firstRow < 0 || lastRow > imgheight || firstRow >= lastRow)
+  {
+    fprintf(stderr, "Error: Rows [%d, %d) are not a valid tile!", firstRow, lastRow);
+    free(window);
+    return (0);
+  }
+  windowHeight = windowLast - windowFirst;
+  tile = window + (firstRow - windowFirst) * imgwidth;
+  tilesize = (Index)(lastRow - firstRow) * imgwidth;
+  offset = (Index)firstRow * imgwidth;
+
+  // only the pixel nodes are needed, Phase2 happens during the merge
+  tree = malloc(sizeof(SalienceTree));
+  root = LargeAlloc((size_t)tilesize * sizeof(Index));
+  edges = malloc((CONNECTIVITY / 2) * (long)tilesize * sizeof(Edge));
+  boundary = malloc(imgwidth * sizeof(Edge));
+  if (tree == NULL || edges == NULL || boundary == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    free(boundary);
+    free(edges);
+    LargeFree(root);
+    free(tree);
+    free(window);
+    return (0);
+  }
+  tree->maxSize = tilesize;
+  tree->curSize = tilesize;
+  tree->imgSize = tilesize;
+  tree->width = imgwidth;
+  tree->firstRow = firstRow;
+  tree->lambdamin = lambdamin;
+  tree->node = LargeAlloc((size_t)tilesize * sizeof(SalienceNode));
+  header.edgeCount = 0;
+  header.boundaryCount = 0;
+
+  // same scan as Phase1, but with local node indices and global edge indices
+  for (y = firstRow, p = 0; y < lastRow; y++)
+  {
+    // row of y inside the window for the edge strength computation
+    wy = y - windowFirst;
+    for (x = 0; x < imgwidth; x++, p++)
+    {
+      MakeSet(tree, root, tile, p);
+      if (y > 0)
+      {
+        edgeSalience = EdgeStrengthY(window, imgwidth, windowHeight, x, wy);
+        if (edgeSalience < lambdamin && y == firstRow)
+        {
+          // the row above belongs to another tile, the merge step joins the two
+          StoreEdge(boundary, &header.boundaryCount, offset + p, EDGE_Y, edgeSalience);
+        }
+        else if (edgeSalience >= lambdamin || !Union(tree, root, p, p - imgwidth))
+        {
+          StoreEdge(edges, &header.edgeCount, offset + p, EDGE_Y, edgeSalience);
+        }
+      }
+      if (x > 0)
+      {
+        edgeSalience = EdgeStrengthX(window, imgwidth, windowHeight, x, wy);
+        if (edgeSalience >= lambdamin || !Union(tree, root, p, p - 1))
+        {
+          StoreEdge(edges, &header.edgeCount, offset + p, EDGE_X, edgeSalience);
+        }
+      }
+    }
+  }
+
+  // turn the local indices into global ones
+  for (p = 0; p < tilesize; p++)
+  {
+    if (tree->node[p].parent != BOTTOM)
+      tree->node[p].parent += offset;
+    if (root[p] != BOTTOM)
+      root[p] += offset;
+  }
+
+  header.magic = TILE_FILE_MAGIC;
+  header.channels = CHANNELS;
+  header.channelBits = CHANNEL_BITS;
+  header.attributes = TileAttributes();
+  header.nodeSize = sizeof(SalienceNode);
+  header.width = imgwidth;
+  header.height = imgheight;
+  header.firstRow = firstRow;
+  header.lastRow = lastRow;
+  header.lambdamin = lambdamin;
+
+  outfile = fopen(partfname, "wb");
+  if (outfile == NULL)
+  {
+    fprintf(stderr, "Error: Can't write the partial tree: %s !", partfname);
+  }
+  else
+  {
+    fwrite(&header, sizeof(TileHeader), 1, outfile);
+    fwrite(tree->node, sizeof(SalienceNode), tilesize, outfile);
+    fwrite(root, sizeof(Index), tilesize, outfile);
+    fwrite(edges, sizeof(Edge), header.edgeCount, outfile);
+    fwrite(boundary, sizeof(Edge), header.boundaryCount, outfile);
+    fclose(outfile);
+  }
+
+  free(boundary);
+  free(edges);
+  LargeFree(root);
+  DeleteTree(tree);
+  free(window);
+  return (outfile != NULL);
+}
+
+/**
+ * @brief Reads the header of a partial tree file and checks that it was written
+ * by a build with the pixel type and attributes of this one, that its rows lie
+ * inside the image and that it belongs to the same image as the reference header.
+ *
+ * @param infile Opened partial tree file
+ * @param fname Path of the file for error messages
+ * @param header Header to fill
+ * @param reference Header of the first part, NULL when reading the first part
+ * @return int 1 if the header is valid, 0 otherwise
+ */
+static int ReadTileHeader(FILE *infile, char *fname, TileHeader *header, TileHeader *reference)
+{
+  if (fread(header, sizeof(TileHeader), 1, infile) != 1 || header->magic != TILE_FILE_MAGIC)
+  {
+    fprintf(stderr, "Error: %s is not a partial tree file!", fname);
+    return (0);
+  }
+  if (header->channels != CHANNELS || header->channelBits != CHANNEL_BITS ||
+      header->attributes != TileAttributes() || header->nodeSize != (int)sizeof(SalienceNode))
+  {
+    fprintf(stderr, "Error: %s was written by a build with another pixel type or other attributes!", fname);
+    return (0);
+  }
+  if (header->width <= 0 || header->height <= 0 || header->firstRow < 0 ||
+      header->lastRow > header->height || header->firstRow >= header->lastRow ||
+      header->edgeCount < 0 || header->boundaryCount < 0)
+  {
+    fprintf(stderr, "Error: %s has no valid tile!", fname);
+    return (0);
+  }
+  if (reference != NULL &&
+      (header->width != reference->width || header->height != reference->height ||
+       header->lambdamin != reference->lambdamin))
+  {
+    fprintf(stderr, "Error: %s belongs to a different image or lambda!", fname);
+    return (0);
+  }
+  return (1);
+}
+
+/**
+ * @brief Frees what MergeTiles has allocated when it stops before the tree is
+ * complete. Every argument may be NULL.
+ */
+static void DeleteMerge(SalienceTree *tree, Index *root, EdgeQueue *queue, Edge *boundary, char *covered)
+{
+  if (tree != NULL)
+    DeleteTree(tree);
+  if (queue != NULL)
+    EdgeQueueDelete(queue);
+  LargeFree(root);
+  free(boundary);
+  free(covered);
+}
+
+/**
+ * @brief Combines the partial trees written by BuildTile into the salience
+ * tree of the whole image. The pixel nodes of all tiles are loaded at their
+ * global position, boundary edges join the flat zones of neighbouring
+ * tiles and all remaining edges are processed by Phase2.
+ * The result is the same tree MakeSalienceTree builds for the whole image.
+ *
+ * @param partfnames Paths of the partial tree files, in any order
+ * @param partCount Number of partial tree files
+ * @param imgwidth Set to the width of the image
+ * @param imgheight Set to the height of the image
+ * @return SalienceTree* The merged tree, NULL on failure
+ */
+SalienceTree *MergeTiles(char **partfnames, int partCount, int *imgwidth, int *imgheight)
+{
+  TileHeader first, header;
+  SalienceTree *tree;
+  EdgeQueue *queue;
+  Edge *boundary, *edges;
+  FILE *infile;
+  char *covered;
+  Index *root;
+  Index p, q, offset, tilesize, imgsize;
+  int i;
+  long j, edgeCount = 0, boundaryCount = 0, b = 0;
+
+  // first pass over the headers to validate the tiles and count the edges
+  for (i = 0; i < partCount; i++)
+  {
+    infile = fopen(partfnames[i], "rb");
+    if (infile == NULL)
+    {
+      fprintf(stderr, "Error: Can't read the partial tree: %s !", partfnames[i]);
+      return (NULL);
+    }
+    if (!ReadTileHeader(infile, partfnames[i], &header, i == 0 ? NULL : &first))
+    {
+      fclose(infile);
+      return (NULL);
+    }
+    fclose(infile);
+    if (i == 0)
+      first = header;
+    edgeCount += header.edgeCount;
+    boundaryCount += header.boundaryCount;
+  }
+  if (!ImageFitsIndex(first.width, first.height))
+    return (NULL);
+  *imgwidth = first.width;
+  *imgheight = first.height;
+  imgsize = (Index)first.width * first.height;
+
+  tree = CreateSalienceTree(first.width, first.height);
+  tree->lambdamin = first.lambdamin;
+  root = LargeAlloc((size_t)imgsize * 2 * sizeof(Index));
+  queue = EdgeQueueCreate(edgeCount);
+  boundary = malloc(boundaryCount * sizeof(Edge));
+  covered = calloc(first.height, sizeof(char));
+  assert(tree != NULL);
+  assert(tree->node != NULL);
+  if (boundary == NULL || covered == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    DeleteMerge(tree, root, queue, boundary, covered);
+    return (NULL);
+  }
+
+  // load every tile at its global position
+  for (i = 0; i < partCount; i++)
+  {
+    infile = fopen(partfnames[i], "rb");
+    if (infile == NULL)
+    {
+      fprintf(stderr, "Error: Can't read the partial tree: %s !", partfnames[i]);
+      DeleteMerge(tree, root, queue, boundary, covered);
+      return (NULL);
+    }
+    if (!ReadTileHeader(infile, partfnames[i], &header, &first))
+    {
+      fclose(infile);
+      DeleteMerge(tree, root, queue, boundary, covered);
+      return (NULL);
+    }
+    for (j = header.firstRow; j < header.lastRow; j++)
+    {
+      if (covered[j])
+      {
+        fprintf(stderr, "Error: Row %ld is part of more than one tile!", j);
+        fclose(infile);
+        DeleteMerge(tree, root, queue, boundary, covered);
+        return (NULL);
+      }
+      covered[j] = true;
+    }
+    offset = (Index)header.firstRow * header.width;
+    tilesize = (Index)(header.lastRow - header.firstRow) * header.width;
+    edges = malloc(header.edgeCount * sizeof(Edge));
+    if (edges == NULL)
+    {
+      fprintf(stderr, "Out of memory!");
+      fclose(infile);
+      DeleteMerge(tree, root, queue, boundary, covered);
+      return (NULL);
+    }
+    if (fread(tree->node + offset, sizeof(SalienceNode), tilesize, infile) != (size_t)tilesize ||
+        fread(root + offset, sizeof(Index), tilesize, infile) != (size_t)tilesize ||
+        fread(edges, sizeof(Edge), header.edgeCount, infile) != (size_t)header.edgeCount ||
+        fread(boundary + b, sizeof(Edge), header.boundaryCount, infile) != (size_t)header.boundaryCount)
+    {
+      fprintf(stderr, "Error: Unexpected end of file: %s !", partfnames[i]);
+      free(edges);
+      fclose(infile);
+      DeleteMerge(tree, root, queue, boundary, covered);
+      return (NULL);
+    }
+    fclose(infile);
+    // edges inside the tile go straight into the queue, boundary edges can only
+    // be evaluated once both tiles are loaded
+    for (j = 0; j < header.edgeCount; j++)
+      EdgeQueuePush(queue, EdgePixel(edges + j), EdgeDirection(edges + j), edges[j].alpha);
+    free(edges);
+    b += header.boundaryCount;
+  }
+  for (j = 0; j < first.height; j++)
+  {
+    if (!covered[j])
+    {
+      fprintf(stderr, "Error: Row %ld is not part of any tile!", j);
+      DeleteMerge(tree, root, queue, boundary, covered);
+      return (NULL);
+    }
+  }
+
+  // join the flat zones across tile boundaries like Phase1 does, the root with
+  // the higher index becomes the parent so that parents keep higher indices
+  for (j = 0; j < boundaryCount; j++)
+  {
+    p = FindRoot1(tree, root, EdgePixel(boundary + j));
+    q = FindRoot1(tree, root, EdgeNeighbour(boundary + j, first.width, first.height));
+    if (p != q && ExceedsOmega(tree, p, q))
+    {
+      EdgeQueuePush(queue, EdgePixel(boundary + j), EDGE_Y, boundary[j].alpha);
+      continue;
+    }
+    if (p != q)
+      Union2(tree, root, MAX(p, q), MIN(p, q));
+    InnerEdge(tree, MAX(p, q));
+  }
+
+  Phase2(tree, queue, root, NULL, first.width, first.height);
+#ifdef ATTRIBUTE_PERIMETER
+  ComputePerimeters(tree, CONNECTIVITY);
+#endif
+
+  free(covered);
+  free(boundary);
+  EdgeQueueDelete(queue);
+  LargeFree(root);
+  return tree;
+}
@@ -0,0 +1,45 @@
+#ifndef TILED_TREE_H
+#define TILED_TREE_H
+
+#include "../util/common.h"
+#include "EdgeQueue.h"
+#include "SalienceTree.h"
+
+// Magic number at the start of every partial tree file ("STP1", "STP8" for the
+// 64 bit indices of INDEX_BITS=64)
+#if INDEX_BITS == 64
+#define TILE_FILE_MAGIC 0x38505453
+#else
+#define TILE_FILE_MAGIC 0x31505453
+#endif
+
+// Flags of the node attributes a build maintains, the nodes of a partial tree
+// file can only be read by a build with the same attributes
+#define TILE_ATTRIBUTE_AREA 1
+#define TILE_ATTRIBUTE_MEAN 2
+#define TILE_ATTRIBUTE_RANGE 4
+#define TILE_ATTRIBUTE_BBOX 8
+#define TILE_ATTRIBUTE_MOMENTS 16
+#define TILE_ATTRIBUTE_PERIMETER 32
+
+// Header of a partial tree file written by a tile worker. The file contains
+// the header followed by the nodes and root entries of all pixels of the tile,
+// the edges above lambdamin and the edges below lambdamin that connect the
+// first row of the tile to the last row of the tile above it.
+typedef struct TileHeader
+{
+  int magic;
+  int channels, channelBits; /* pixel type of the build that wrote the file */
+  int attributes;         /* TILE_ATTRIBUTE_* flags of the node attributes */
+  int nodeSize;           /* sizeof(SalienceNode) */
+  int width, height;      /* dimensions of the whole image */
+  int firstRow, lastRow;  /* rows [firstRow, lastRow) belong to the tile */
+  double lambdamin;
+  long edgeCount;         /* edges with alpha >= lambdamin */
+  long boundaryCount;     /* edges below lambdamin between firstRow and firstRow - 1 */
+} TileHeader;
+
+int BuildTile(char *imgfname, double lambdamin, int firstRow, int lastRow, char *partfname);
+SalienceTree *MergeTiles(char **partfnames, int partCount, int *imgwidth, int *imgheight);
+
+#endif
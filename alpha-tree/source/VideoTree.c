@@ -0,0 +1,621 @@
+#include "VideoTree.h"
+#include "../util/EdgeDetection.h"
+#include "../util/PageAlloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+/**
+ * @brief Checks whether the internal nodes can be kept from frame to frame, with
+ * the omegafactor of the process. Builds with the PERIMETER attribute count the
+ * edges of every node while all components are joined, an omega that rejects
+ * merges can let a kept component join a neighbour below its own alpha in the new
+ * frame, and with a lambdamin of 0 Phase2 also joins flat zones. These trees are
+ * built from the flat zones up on every frame.
+ */
+static boolean KeepsNodes(double lambdamin)
+{
+#ifdef ATTRIBUTE_PERIMETER
+  (void)lambdamin;
+  return (false);
+#else
+#ifdef ATTRIBUTE_RANGE
+  if (omegafactor < CHANNEL_MAX)
+    return (false);
+#endif
+  return (lambdamin > 0);
+#endif
+}
+
+/**
+ * @brief Allocates the state of a video of which every frame has the given size.
+ *
+ * @param width of the frames
+ * @param height of the frames
+ * @param lambdamin threshold to determine if we have encountered an edge
+ * @return VideoTree* The state without a previous frame
+ */
+VideoTree *CreateVideoTree(int width, int height, double lambdamin)
+{
+  VideoTree *video = malloc(sizeof(VideoTree));
+  Index imgsize = (Index)width * height;
+
+  video->width = width;
+  video->height = height;
+  video->lambdamin = lambdamin;
+  video->frame = NULL;
+  video->strengthX = malloc(imgsize * sizeof(double));
+  video->strengthY = malloc(imgsize * sizeof(double));
+  video->keepNodes = KeepsNodes(lambdamin);
+  video->zone = malloc(imgsize * sizeof(Index));
+  video->zones = video->keepNodes ? NULL : malloc(imgsize * sizeof(SalienceNode));
+  video->touched = malloc(imgsize * sizeof(boolean));
+  video->reset = malloc(imgsize * sizeof(boolean));
+  video->above = malloc(imgsize * sizeof(Index));
+  video->number = malloc(imgsize * sizeof(Index));
+  video->edges = NULL;
+  video->meet = NULL;
+  video->edgeCount = video->edgeMax = 0;
+  video->fresh = NULL;
+  video->freshCount = video->freshMax = 0;
+  video->merged = NULL;
+  video->mergedMeet = NULL;
+  video->mergedMax = 0;
+  video->work = NULL;
+  video->workMeet = NULL;
+  video->workCount = video->workMax = 0;
+  video->keptNodes = 0;
+  video->tree = CreateSalienceTree(width, height);
+  video->root = LargeAlloc((size_t)imgsize * 2 * sizeof(Index));
+  assert(video->tree != NULL);
+  assert(video->tree->node != NULL);
+  if (video->strengthX == NULL || video->strengthY == NULL || video->zone == NULL ||
+      (video->zones == NULL && !video->keepNodes) ||
+      video->touched == NULL || video->reset == NULL || video->above == NULL ||
+      video->number == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  return video;
+}
+
+/**
+ * @brief Free memory allocated for the state of a video, including the tree
+ * of the last frame.
+ *
+ * @param video State to free the memory of
+ */
+void DeleteVideoTree(VideoTree *video)
+{
+  free(video->frame);
+  free(video->strengthX);
+  free(video->strengthY);
+  free(video->zone);
+  free(video->zones);
+  free(video->touched);
+  free(video->reset);
+  free(video->above);
+  free(video->number);
+  free(video->edges);
+  free(video->meet);
+  free(video->fresh);
+  free(video->merged);
+  free(video->mergedMeet);
+  free(video->work);
+  free(video->workMeet);
+  DeleteTree(video->tree);
+  LargeFree(video->root);
+  free(video);
+}
+
+/**
+ * @brief Adds an edge to the edges found while rebuilding flat zones.
+ */
+static void PushFresh(VideoTree *video, Index p, int direction, double alpha)
+{
+  if (video->freshCount == video->freshMax)
+  {
+    video->freshMax += MAX(EDGE_QUEUE_CHUNK, video->freshMax / 2);
+    video->fresh = realloc(video->fresh, video->freshMax * sizeof(Edge));
+    if (video->fresh == NULL)
+    {
+      fprintf(stderr, "Out of memory!");
+      exit(-1);
+    }
+  }
+  video->fresh[video->freshCount].pixel = EdgeEncode(p, direction);
+  video->fresh[video->freshCount].alpha = (float)alpha;
+  video->freshCount++;
+}
+
+/**
+ * @brief Makes room for count edges in a list of edges and the nodes in which
+ * their pixels meet.
+ */
+static void GrowEdges(Edge **edges, Index **meet, long *max, long count)
+{
+  if (*max >= count)
+    return;
+  *max = count;
+  *edges = realloc(*edges, count * sizeof(Edge));
+  *meet = realloc(*meet, count * sizeof(Index));
+  if (*edges == NULL || *meet == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+}
+
+static int CompareEdges(const void *a, const void *b)
+{
+  float alphaA = ((Edge *)a)->alpha, alphaB = ((Edge *)b)->alpha;
+
+  return ((alphaA > alphaB) - (alphaA < alphaB));
+}
+
+/**
+ * @brief Marks the pixels of which an edge strength can differ from the previous
+ * frame. The strength of an edge depends on the pixels around it, so this is every
+ * pixel within distance one of a changed pixel.
+ *
+ * @return Index The number of changed pixels
+ */
+static Index MarkTouched(VideoTree *video, Pixel *frame)
+{
+  int width = video->width, height = video->height;
+  Index p, imgsize = (Index)width * height;
+  Index changed = 0;
+  int x, y, dx, dy;
+
+  if (video->frame == NULL)
+  {
+    for (p = 0; p < imgsize; p++)
+      video->touched[p] = true;
+    return (imgsize);
+  }
+  memset(video->touched, false, imgsize * sizeof(boolean));
+  for (y = 0, p = 0; y < height; y++)
+  {
+    for (x = 0; x < width; x++, p++)
+    {
+      if (memcmp(frame[p], video->frame[p], sizeof(Pixel)) == 0)
+        continue;
+      changed++;
+      for (dy = MAX(y - 1, 0); dy <= MIN(y + 1, height - 1); dy++)
+        for (dx = MAX(x - 1, 0); dx <= MIN(x + 1, width - 1); dx++)
+          video->touched[(Index)dy * width + dx] = true;
+    }
+  }
+  return (changed);
+}
+
+/**
+ * @brief Marks every pixel of a flat zone of the previous frame that contains a
+ * touched pixel. These flat zones are rebuilt, all others are kept.
+ */
+static void MarkReset(VideoTree *video)
+{
+  Index imgsize = (Index)video->width * video->height;
+  Index p, r;
+
+  // the first frame has no flat zones to keep
+  if (video->frame == NULL)
+  {
+    for (p = 0; p < imgsize; p++)
+      video->reset[p] = true;
+    return;
+  }
+  memset(video->reset, false, imgsize * sizeof(boolean));
+  // first flag the root pixel of every touched flat zone
+  for (p = 0; p < imgsize; p++)
+  {
+    if (video->touched[p])
+    {
+      r = video->zone[p];
+      video->reset[r == BOTTOM ? p : r] = true;
+    }
+  }
+  // then every pixel takes over the flag of its root
+  for (p = 0; p < imgsize; p++)
+  {
+    r = video->zone[p];
+    if (r != BOTTOM)
+      video->reset[p] = video->reset[r];
+  }
+}
+
+/**
+ * @brief Drops the nodes of the previous tree on the path from node i, the
+ * parent of a flat zone, to the root, starting at the first one with an alpha of
+ * at least alpha. The ancestors of a dropped node are dropped, so the walk stops
+ * at the first node that already is.
+ */
+static void DropNodes(VideoTree *video, Index i, double alpha)
+{
+  SalienceNode *node = video->tree->node;
+  Index imgsize = video->tree->imgSize, *number = video->number;
+
+  while (i >= imgsize && number[i - imgsize] != BOTTOM && node[i].alpha < alpha)
+    i = node[i].parent;
+  while (i >= imgsize && number[i - imgsize] != BOTTOM)
+  {
+    number[i - imgsize] = BOTTOM;
+    i = node[i].parent;
+  }
+}
+
+/**
+ * @brief Drops the nodes of the previous tree that an edge between kept pixel p
+ * and a rebuilt flat zone changes: those above the flat zone of p at or above the
+ * level at which Phase2 adds the edge, or all of them when the edge joins the
+ * flat zones. Nothing is dropped when p is rebuilt itself.
+ */
+static void DropAbove(VideoTree *video, Index p, double alpha)
+{
+  Index r;
+
+  if (!video->keepNodes || video->reset[p])
+    return;
+  // the level of the edge, quantized as Phase2 does
+  if (alphaStep > 0)
+    alpha = ceil(alpha / alphaStep) * alphaStep;
+  r = video->zone[p] == BOTTOM ? p : video->zone[p];
+  DropNodes(video, video->above[r], alpha);
+}
+
+/**
+ * @brief Remembers the parent of every flat zone in the tree of the previous
+ * frame and drops the internal nodes above the flat zones that are rebuilt.
+ * When no nodes can be kept all of them are dropped.
+ */
+static void MarkDropped(VideoTree *video)
+{
+  SalienceTree *tree = video->tree;
+  Index imgsize = tree->imgSize, i, p;
+
+  for (i = imgsize; i < tree->curSize; i++)
+    video->number[i - imgsize] = video->keepNodes ? 0 : BOTTOM;
+  if (!video->keepNodes || video->frame == NULL)
+    return;
+  for (p = 0; p < imgsize; p++)
+  {
+    if (video->zone[p] != BOTTOM)
+      continue;
+    video->above[p] = tree->node[p].parent;
+    if (video->reset[p])
+      DropNodes(video, video->above[p], 0);
+  }
+}
+
+/**
+ * @brief Handles the edge between pixel p at (x,y) and its left (EDGE_X) or upper
+ * (EDGE_Y) neighbour like Phase1 does. The strength is only recomputed when one of
+ * the pixels is touched. The root with the higher index becomes the parent, so
+ * every flat zone keeps the pixel with the highest index as its root.
+ */
+static void RebuildEdge(VideoTree *video, Pixel *frame, Index p, int x, int y, int direction)
+{
+  SalienceTree *tree = video->tree;
+  Index q = p - (direction == EDGE_X ? 1 : video->width);
+  Index rp, rq;
+  double edgeSalience;
+
+  if (direction == EDGE_X)
+  {
+    if (video->touched[p] || video->touched[q])
+      video->strengthX[p] = EdgeStrengthX(frame, video->width, video->height, x, y);
+    edgeSalience = video->strengthX[p];
+  }
+  else
+  {
+    if (video->touched[p] || video->touched[q])
+      video->strengthY[p] = EdgeStrengthY(frame, video->width, video->height, x, y);
+    edgeSalience = video->strengthY[p];
+  }
+  if (edgeSalience >= video->lambdamin)
+  {
+    PushFresh(video, p, direction, edgeSalience);
+    DropAbove(video, p, (float)edgeSalience);
+    DropAbove(video, q, (float)edgeSalience);
+    return;
+  }
+  rp = FindRoot1(tree, video->root, p);
+  rq = FindRoot1(tree, video->root, q);
+  if (rp != rq && ExceedsOmega(tree, rp, rq))
+  {
+    PushFresh(video, p, direction, edgeSalience);
+    DropAbove(video, p, (float)edgeSalience);
+    DropAbove(video, q, (float)edgeSalience);
+    return;
+  }
+  if (rp != rq)
+  {
+    // a kept flat zone that grows changes all nodes above it
+    Union2(tree, video->root, MAX(rp, rq), MIN(rp, rq));
+    DropAbove(video, p, 0);
+    DropAbove(video, q, 0);
+  }
+  InnerEdge(tree, MAX(rp, rq));
+}
+
+/**
+ * @brief Phase1 for a frame of a video. The pixel nodes of kept flat zones are
+ * copied from the previous frame, the pixels of all other flat zones start as
+ * new sets and every edge that has a pixel of such a zone at one of its ends is
+ * handled again.
+ */
+static void RebuildFlatZones(VideoTree *video, Pixel *frame)
+{
+  SalienceTree *tree = video->tree;
+  int width = video->width, height = video->height;
+  Index p;
+  int x, y;
+
+  for (p = 0; p < (Index)width * height; p++)
+  {
+    if (video->reset[p])
+    {
+      MakeSet(tree, video->root, frame, p);
+    }
+    else
+    {
+      // the tree still holds the pixel nodes when it keeps its nodes, only
+      // the root pixels lose their parent
+      if (!video->keepNodes)
+        tree->node[p] = video->zones[p];
+      else if (video->zone[p] == BOTTOM)
+        tree->node[p].parent = BOTTOM;
+      video->root[p] = video->zone[p];
+    }
+  }
+  video->freshCount = 0;
+  for (y = 0, p = 0; y < height; y++)
+  {
+    for (x = 0; x < width; x++, p++)
+    {
+      if (!video->reset[p])
+        continue;
+      // edges to the upper and left neighbour
+      if (y > 0)
+        RebuildEdge(video, frame, p, x, y, EDGE_Y);
+      if (x > 0)
+        RebuildEdge(video, frame, p, x, y, EDGE_X);
+      // edges to the lower and right neighbour, unless that pixel handles them itself
+      if (y < height - 1 && !video->reset[p + width])
+        RebuildEdge(video, frame, p + width, x, y + 1, EDGE_Y);
+      if (x < width - 1 && !video->reset[p + 1])
+        RebuildEdge(video, frame, p + 1, x + 1, y, EDGE_X);
+    }
+  }
+}
+
+/**
+ * @brief Makes every pixel point straight at the root of its flat zone and keeps
+ * the flat zones for the next frame, with a copy of the pixel nodes when the tree
+ * does not keep them. In Phase1 root and the parents of the pixels are the same,
+ * so only root is read. Parents have higher indices than their children, so going
+ * down from the last pixel every parent already points at its root.
+ */
+static void KeepFlatZones(VideoTree *video)
+{
+  SalienceNode *node = video->tree->node;
+  Index imgsize = (Index)video->width * video->height, *root = video->root;
+  Index p, q;
+
+  for (p = imgsize - 1; p >= 0; p--)
+  {
+    q = root[p];
+    if (q != BOTTOM && root[q] != BOTTOM)
+    {
+      root[p] = root[q];
+      node[p].parent = root[p];
+    }
+  }
+  memcpy(video->zone, root, imgsize * sizeof(Index));
+  if (!video->keepNodes)
+    memcpy(video->zones, node, imgsize * sizeof(SalienceNode));
+}
+
+/**
+ * @brief Moves the kept internal nodes of the previous tree to the front of the
+ * internal nodes, in their old order, and hangs the kept flat zones back under
+ * them. A node that is not dropped is kept when its parent is kept, or when it
+ * is a level root below a dropped parent: then it holds a whole component of its
+ * level, of which the new frame changes neither the pixels nor the edges up to
+ * its alpha. Phase2 takes such a component over as it is. Afterwards root points
+ * every node at the top of its component.
+ */
+static void KeepNodes(VideoTree *video)
+{
+  SalienceTree *tree = video->tree;
+  SalienceNode *node = tree->node;
+  Index imgsize = tree->imgSize, *number = video->number;
+  Index i, parent, count = imgsize;
+
+  // going down every parent is decided before its children
+  for (i = tree->curSize - 1; i >= imgsize; i--)
+  {
+    parent = node[i].parent;
+    if (number[i - imgsize] != BOTTOM &&
+        (parent == BOTTOM || (number[parent - imgsize] == BOTTOM && node[i].alpha >= node[parent].alpha)))
+      number[i - imgsize] = BOTTOM;
+  }
+  for (i = imgsize; i < tree->curSize; i++)
+  {
+    if (number[i - imgsize] != BOTTOM)
+      number[i - imgsize] = count++;
+  }
+  // nodes only move down, so every node is read before its place is taken
+  for (i = imgsize; i < tree->curSize; i++)
+  {
+    if (number[i - imgsize] == BOTTOM)
+      continue;
+    parent = number[node[i].parent - imgsize];
+    node[number[i - imgsize]] = node[i];
+    node[number[i - imgsize]].parent = parent;
+  }
+  tree->curSize = count;
+  video->keptNodes = count - imgsize;
+
+  // parents have higher indices, so going down every parent already knows its top
+  for (i = count - 1; i >= 0; i--)
+  {
+    if (i >= imgsize)
+      parent = node[i].parent;
+    else
+    {
+      // root holds the flat zones, only kept root pixels need their old parent
+      parent = video->root[i];
+      if (parent == BOTTOM && video->keepNodes && !video->reset[i] && video->above[i] >= imgsize)
+        parent = node[i].parent = number[video->above[i] - imgsize];
+    }
+    if (parent == BOTTOM || video->root[parent] == BOTTOM)
+      video->root[i] = parent;
+    else
+      video->root[i] = video->root[parent];
+  }
+}
+
+/**
+ * @brief Merges the edges of the previous frame between kept flat zones with the
+ * edges found while rebuilding into the sorted edge list of the frame. The kept
+ * edges take the new index of the node in which their pixels met, edges of which
+ * that node was dropped and the new edges have to go through Phase2.
+ */
+static void MergeEdges(VideoTree *video)
+{
+  Edge *swap;
+  Index *swapMeet, p, m, imgsize = video->tree->imgSize;
+  long i, j, n, kept = 0, swapMax;
+
+  // drop the edges of the previous frame that touch a rebuilt flat zone
+  for (i = 0; i < video->edgeCount; i++)
+  {
+    p = EdgePixel(video->edges + i);
+    if (video->reset[p] || video->reset[EdgeNeighbour(video->edges + i, video->width, video->height)])
+      continue;
+    m = video->meet[i];
+    video->edges[kept] = video->edges[i];
+    video->meet[kept] = m >= imgsize ? video->number[m - imgsize] : BOTTOM;
+    kept++;
+  }
+  qsort(video->fresh, video->freshCount, sizeof(Edge), CompareEdges);
+
+  n = kept + video->freshCount;
+  GrowEdges(&video->merged, &video->mergedMeet, &video->mergedMax, n);
+  for (i = 0, j = 0; i < kept || j < video->freshCount;)
+  {
+    if (j == video->freshCount || (i < kept && video->edges[i].alpha <= video->fresh[j].alpha))
+    {
+      video->merged[i + j] = video->edges[i];
+      video->mergedMeet[i + j] = video->meet[i];
+      i++;
+    }
+    else
+    {
+      video->merged[i + j] = video->fresh[j];
+      video->mergedMeet[i + j] = BOTTOM;
+      j++;
+    }
+  }
+
+  // the merged list becomes the edge list of the frame
+  swap = video->edges;
+  swapMeet = video->meet;
+  swapMax = video->edgeMax;
+  video->edges = video->merged;
+  video->meet = video->mergedMeet;
+  video->edgeMax = video->mergedMax;
+  video->merged = swap;
+  video->mergedMeet = swapMeet;
+  video->mergedMax = swapMax;
+  video->edgeCount = n;
+}
+
+/**
+ * @brief Phase2 for a frame of a video. Edges of which the pixels met in a kept
+ * node, or of which both pixels are in the same kept component, are already part
+ * of the kept nodes. Only the other edges, in order, are added by Phase2Sorted,
+ * which records where their pixels meet for the next frame.
+ */
+static void BuildUpperLevels(VideoTree *video)
+{
+  Index *root = video->root, p, q;
+  long i, n = 0;
+
+  GrowEdges(&video->work, &video->workMeet, &video->workMax, video->edgeCount);
+  for (i = 0; i < video->edgeCount; i++)
+  {
+    if (video->meet[i] != BOTTOM)
+      continue;
+    // trees that do not keep their nodes count the edges within a component
+    // for the perimeter, of the others root still points every pixel straight
+    // at the top of its component
+    if (!video->keepNodes)
+    {
+      video->work[n++] = video->edges[i];
+      continue;
+    }
+    p = EdgePixel(video->edges + i);
+    q = EdgeNeighbour(video->edges + i, video->width, video->height);
+    p = root[p] == BOTTOM ? p : root[p];
+    q = root[q] == BOTTOM ? q : root[q];
+    if (p == q)
+      video->meet[i] = p;
+    else
+      video->work[n++] = video->edges[i];
+  }
+  Phase2Sorted(video->tree, video->work, n, video->root, video->width, video->height, video->workMeet);
+  // the edges of the work list come in the same order
+  for (i = 0, n = 0; i < video->edgeCount; i++)
+  {
+    if (video->meet[i] == BOTTOM)
+      video->meet[i] = video->workMeet[n++];
+  }
+  video->workCount = n;
+}
+
+/**
+ * @brief Builds the tree of the next frame of a video. Only the flat zones that
+ * contain or border a pixel that differs from the previous frame are rebuilt,
+ * and only the edge strengths around changed pixels are recomputed. The internal
+ * nodes above the rebuilt flat zones, and those that a changed edge joins at or
+ * below their alpha, are dropped, all others are kept with their alphas and
+ * attributes. Phase2 then only adds the edges that are not inside a kept
+ * component, taken from the sorted edge list of the previous frame into which
+ * the new edges are merged, so the union-find work of a frame follows the motion
+ * rather than the size of the frame. Without an omega constraint the tree gives
+ * the same output as MakeSalienceTree on the frame.
+ *
+ * @param video State of the video, updated to the new frame
+ * @param frame The new frame, owned by the video state afterwards
+ * @param changed Set to the number of pixels that differ from the previous frame
+ * @return SalienceTree* Tree of the frame, valid until the next update
+ */
+SalienceTree *VideoTreeUpdate(VideoTree *video, Pixel *frame, Index *changed)
+{
+  *changed = MarkTouched(video, frame);
+  if (*changed == 0)
+  {
+    video->keptNodes = video->tree->curSize - video->tree->imgSize;
+    video->workCount = 0;
+    free(frame);
+    return video->tree;
+  }
+  MarkReset(video);
+  MarkDropped(video);
+  RebuildFlatZones(video, frame);
+  KeepFlatZones(video);
+  KeepNodes(video);
+  MergeEdges(video);
+  BuildUpperLevels(video);
+#ifdef ATTRIBUTE_PERIMETER
+  ComputePerimeters(video->tree, CONNECTIVITY);
+#endif
+
+  free(video->frame);
+  video->frame = frame;
+  return video->tree;
+}
@@ -0,0 +1,49 @@
+#ifndef VIDEO_TREE_H
+#define VIDEO_TREE_H
+
+#include "../util/common.h"
+#include "EdgeQueue.h"
+#include "SalienceTree.h"
+
+// State that is kept from one frame of a video to the next. After Phase1 of a
+// frame the pixel nodes hold the flat zones of the frame, every pixel pointing
+// straight at the pixel with the highest index in its flat zone. Flat zones that
+// do not contain or border a changed pixel are taken over by the next frame, and
+// so are the internal nodes of which the subtree is not reached by a changed edge.
+// Trees that keep their internal nodes take the pixel nodes over from the tree
+// itself, all others from a copy made after Phase1.
+typedef struct VideoTree
+{
+  int width, height;
+  double lambdamin;
+  Pixel *frame;           /* previous frame, NULL before the first frame */
+  double *strengthX;      /* edge strength between p and p - 1 */
+  double *strengthY;      /* edge strength between p and p - width */
+  boolean keepNodes;      /* internal nodes are taken over from frame to frame */
+  Index *zone;            /* root pixel of the flat zone of every pixel, BOTTOM for the root */
+  SalienceNode *zones;    /* pixel nodes after Phase1 of the previous frame, NULL if keepNodes */
+  boolean *touched;       /* pixels whose edges have to be recomputed */
+  boolean *reset;         /* pixels whose flat zone has to be rebuilt */
+  Index *above;           /* parent of every flat zone in the tree of the previous frame */
+  Index *number;          /* index of every kept internal node in the new tree, BOTTOM if dropped */
+  Edge *edges;            /* edges of the frame that go to Phase2, sorted by alpha */
+  Index *meet;            /* node that holds both pixels of every edge, BOTTOM if not built yet */
+  long edgeCount, edgeMax;
+  Edge *fresh;            /* edges of rebuilt flat zones that go to Phase2 */
+  long freshCount, freshMax;
+  Edge *merged;           /* room for merging the two lists above */
+  Index *mergedMeet;
+  long mergedMax;
+  Edge *work;             /* edges that Phase2 adds to the kept nodes */
+  Index *workMeet;
+  long workCount, workMax;
+  Index keptNodes;        /* internal nodes taken over from the previous frame */
+  SalienceTree *tree;
+  Index *root;
+} VideoTree;
+
+VideoTree *CreateVideoTree(int width, int height, double lambdamin);
+void DeleteVideoTree(VideoTree *video);
+SalienceTree *VideoTreeUpdate(VideoTree *video, Pixel *frame, Index *changed);
+
+#endif
@@ -0,0 +1,142 @@
+#include "VolumeTree.h"
+#include "../util/EdgeDetection.h"
+#include "../util/PageAlloc.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+/**
+ * @brief Builds the salience tree of a volume with 6-connectivity. The voxel with
+ * coordinates (x,y,z) is node z * width * height + y * width + x of the tree.
+ * The slices are read one after the other, so only two slices and the edges
+ * above lambdamin are kept in memory besides the tree itself.
+ * 
+ * @param readSlice Function that reads a slice of the volume
+ * @param depth Number of slices
+ * @param lambdamin threshold to determine if we have encountered an edge
+ * @param volwidth Set to the width of the slices
+ * @param volheight Set to the height of the slices
+ * @return SalienceTree* The tree of the volume, NULL on failure
+ */
+SalienceTree *MakeVolumeTree(SliceReader readSlice, int depth, double lambdamin, int *volwidth, int *volheight)
+{
+  SalienceTree *tree;
+  EdgeQueue *queue;
+  Pixel *first;
+  Index *root;
+  Index volsize;
+
+  first = readSlice(0, volwidth, volheight);
+  if (first == NULL)
+    return (NULL);
+  // nodes are indexed by Index and edges keep two bits for their direction
+  if (depth < 1 || (long)(*volwidth) * (*volheight) * depth > INDEX_PIXELS_MAX)
+  {
+    fprintf(stderr, "Error: A volume of %dx%dx%d voxels is too large!", *volwidth, *volheight, depth);
+    free(first);
+    return (NULL);
+  }
+  volsize = (Index)(*volwidth) * (*volheight) * depth;
+
+  queue = EdgeQueueCreate(MIN(EDGE_QUEUE_CHUNK, 3 * (long)volsize));
+  root = LargeAlloc((size_t)volsize * 2 * sizeof(Index));
+  // the coordinates of the voxels continue from slice to slice
+  tree = CreateSalienceTree(*volwidth, (*volheight) * depth);
+  assert(tree != NULL);
+  assert(tree->node != NULL);
+  Progress("Phase1 started\n");
+  if (!Phase1Volume(tree, queue, root, readSlice, first, *volwidth, *volheight, depth, lambdamin))
+  {
+    EdgeQueueDelete(queue);
+    LargeFree(root);
+    DeleteTree(tree);
+    return (NULL);
+  }
+  Progress("Phase2 started\n");
+  // Phase2 only needs the width and height to find the second voxel of an edge
+  Phase2(tree, queue, root, NULL, *volwidth, *volheight);
+  Progress("Phase2 done\n");
+#ifdef ATTRIBUTE_PERIMETER
+  // the perimeter of a volume is the number of voxel sides on its surface
+  ComputePerimeters(tree, 6);
+#endif
+  EdgeQueueDelete(queue);
+  LargeFree(root);
+  return tree;
+}
+
+/**
+ * @brief Phase1 for a volume. Every slice is handled like an image in Phase1,
+ * and every voxel is additionally compared to the voxel at the same position
+ * in the previous slice. A slice is freed as soon as the next one has been
+ * processed.
+ * 
+ * @param tree Salience Tree we are working on
+ * @param queue Edge queue to push to
+ * @param root 
+ * @param readSlice Function that reads a slice of the volume
+ * @param first The first slice, already read
+ * @param width of the slices
+ * @param height of the slices
+ * @param depth Number of slices
+ * @param lambdamin threshold to determine if we have encountered an edge
+ * @return boolean false if a slice could not be read
+ */
+boolean Phase1Volume(SalienceTree *tree, EdgeQueue *queue, Index *root, SliceReader readSlice, Pixel *first, int width, int height, int depth, double lambdamin)
+{
+  Index slicesize = (Index)width * height;
+  Index p;
+  int x, y, z, slicewidth, sliceheight;
+  Pixel *prev = NULL, *cur = first;
+  double edgeSalience;
+
+  for (z = 0, p = 0; z < depth; z++)
+  {
+    if (z > 0)
+    {
+      cur = readSlice(z, &slicewidth, &sliceheight);
+      if (cur == NULL)
+      {
+        free(prev);
+        return (false);
+      }
+      if (slicewidth != width || sliceheight != height)
+      {
+        fprintf(stderr, "Error: Slice %d is %dx%d instead of %dx%d!", z, slicewidth, sliceheight, width, height);
+        free(cur);
+        free(prev);
+        return (false);
+      }
+    }
+    for (y = 0; y < height; y++)
+    {
+      for (x = 0; x < width; x++, p++)
+      {
+        MakeSetPixel(tree, root, cur[y * width + x], p);
+        if (z > 0)
+        {
+          edgeSalience = EdgeStrengthZ(prev, cur, width, height, x, y);
+          if (edgeSalience >= lambdamin || !Union(tree, root, p, p - slicesize))
+            EdgeQueuePush(queue, p, EDGE_Z, edgeSalience);
+        }
+        if (y > 0)
+        {
+          edgeSalience = EdgeStrengthY(cur, width, height, x, y);
+          if (edgeSalience >= lambdamin || !Union(tree, root, p, p - width))
+            EdgeQueuePush(queue, p, EDGE_Y, edgeSalience);
+        }
+        if (x > 0)
+        {
+          edgeSalience = EdgeStrengthX(cur, width, height, x, y);
+          if (edgeSalience >= lambdamin || !Union(tree, root, p, p - 1))
+            EdgeQueuePush(queue, p, EDGE_X, edgeSalience);
+        }
+      }
+    }
+    // the previous slice is no longer needed for the edges of the next one
+    free(prev);
+    prev = cur;
+  }
+  free(prev);
+  return (true);
+}
@@ -0,0 +1,15 @@
+#ifndef VOLUME_TREE_H
+#define VOLUME_TREE_H
+
+#include "../util/common.h"
+#include "EdgeQueue.h"
+#include "SalienceTree.h"
+
+// Reads slice z of a volume. Returns the newly allocated pixels of the slice and
+// sets its dimensions, or returns NULL on failure.
+typedef Pixel *(*SliceReader)(int z, int *slicewidth, int *sliceheight);
+
+SalienceTree *MakeVolumeTree(SliceReader readSlice, int depth, double lambdamin, int *volwidth, int *volheight);
+boolean Phase1Volume(SalienceTree *tree, EdgeQueue *queue, Index *root, SliceReader readSlice, Pixel *first, int width, int height, int depth, double lambdamin);
+
+#endif
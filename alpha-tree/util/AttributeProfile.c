@@ -0,0 +1,250 @@
+#include "AttributeProfile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifdef ATTRIBUTE_MEAN
+
+// The work of one thread: the pixels of a block of rows
+typedef struct ProfileBlock
+{
+  SalienceTree *tree;
+  int *rank;       /* per level root the number of lambdas it is kept at, -1 for other nodes */
+  Index *next;     /* per level root the nearest ancestor kept at more lambdas */
+  int count;
+  boolean *black;  /* lambdas at which the filter gives a black image */
+  float *features;
+  long first, last;
+} ProfileBlock;
+
+/**
+ * @brief Counts the lambdas that are not larger than a value.
+ */
+static int Rank(double value, double *lambda, int count)
+{
+  int low = 0, high = count, middle;
+
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+    if (lambda[middle] <= value)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return (low);
+}
+
+/**
+ * @brief Writes the rank and next of the pixels of one block before the tree is
+ * linked, so that their pages are placed on the NUMA node of the thread that
+ * reads them in ProfileRows. The pixels are the first nodes of the tree.
+ */
+static void *TouchRows(void *arg)
+{
+  ProfileBlock *block = arg;
+  long p;
+
+  for (p = block->first; p < block->last; p++)
+  {
+    block->rank[p] = -1;
+    block->next[p] = BOTTOM;
+  }
+  return (NULL);
+}
+
+/**
+ * @brief Runs a function on every block, in a thread per block. The blocks no
+ * thread can be started for are done by this one.
+ */
+static void RunBlocks(ProfileBlock *blocks, pthread_t *thread, int threads, void *(*function)(void *))
+{
+  int t, started;
+
+  for (started = 0; started < threads; started++)
+    if (pthread_create(thread + started, NULL, function, blocks + started) != 0)
+      break;
+  for (t = started; t < threads; t++)
+    function(blocks + t);
+  for (t = 0; t < started; t++)
+    pthread_join(thread[t], NULL);
+}
+
+/**
+ * @brief Writes the features of the pixels of one block. Starting from the level
+ * root of a pixel, every step to next keeps the node at more lambdas, so the
+ * ancestor chain is followed for at most count steps.
+ */
+static void *ProfileRows(void *arg)
+{
+  ProfileBlock *block = arg;
+  SalienceNode *node = block->tree->node;
+  int count = block->count, k, j;
+  Index a;
+  float *feature, value;
+  long p;
+
+  for (p = block->first; p < block->last; p++)
+  {
+    feature = block->features + p * ProfileFeatures(count);
+    a = block->rank[p] < 0 ? block->next[p] : (Index)p;
+    for (k = 0; k < count; k++)
+    {
+      // the output at lambda k is the lowest level root kept at it
+      while (block->rank[a] <= k)
+        a = block->next[a];
+      for (j = 0; j < CHANNELS; j++)
+      {
+        value = block->black[k] ? 0 : (Channel)(node[a].sumPix[j] / node[a].area);
+        feature[k * CHANNELS + j] = value;
+        if (k > 0)
+          feature[(count + k - 1) * CHANNELS + j] = feature[(k - 1) * CHANNELS + j] - value;
+      }
+    }
+  }
+  return (NULL);
+}
+
+#endif
+
+/**
+ * @brief Computes the attribute profiles of every pixel, the output of
+ * SalienceTreeAreaFilter or SalienceTreeSalienceFilter at every lambda and the
+ * differences between consecutive outputs (differential attribute profiles),
+ * into an array of ProfileFeatures(count) floats per pixel, row after row.
+ * One pass down the tree links every level root to the nearest ancestor that is
+ * kept at more lambdas, after which the pixels are handled in parallel blocks
+ * of rows, each following at most count links.
+ *
+ * @param tree Tree to draw
+ * @param attribute FILTER_AREA or FILTER_SALIENCE
+ * @param lambda Increasing lambdas
+ * @param count Number of lambdas
+ * @param features Output of ProfileFeatures(count) floats per pixel
+ * @param threads Number of threads
+ * @return int 0 on success, -1 on failure
+ */
+int SalienceTreeAttributeProfiles(SalienceTree *tree, int attribute, double *lambda, int count, float *features, int threads)
+{
+#ifndef ATTRIBUTE_MEAN
+  fprintf(stderr, "Error: Attribute profiles need a build with the MEAN attribute!");
+  return (-1);
+#else
+  SalienceNode *node = tree->node;
+  Index imgsize = tree->imgSize, rootIndex = tree->curSize - 1, *next, i, parent;
+  int rows = imgsize / tree->width, *rank, k;
+  boolean black[count];
+  ProfileBlock *blocks;
+  pthread_t *thread;
+  int t;
+
+  if (attribute != FILTER_AREA && attribute != FILTER_SALIENCE)
+  {
+    fprintf(stderr, "Error: Attribute profiles are only made for area and salience!");
+    return (-1);
+  }
+
+  // the filters give a black image when lambda removes the root as well
+  for (k = 0; k < count; k++)
+    black[k] = attribute == FILTER_AREA ? lambda[k] > imgsize : lambda[k] > node[rootIndex].alpha;
+
+  threads = MAX(1, MIN(threads, rows));
+  rank = malloc(tree->curSize * sizeof(int));
+  next = malloc(tree->curSize * sizeof(Index));
+  blocks = malloc(threads * sizeof(ProfileBlock));
+  thread = malloc(threads * sizeof(pthread_t));
+  if (rank == NULL || next == NULL || blocks == NULL || thread == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  for (t = 0; t < threads; t++)
+  {
+    blocks[t].tree = tree;
+    blocks[t].rank = rank;
+    blocks[t].next = next;
+    blocks[t].count = count;
+    blocks[t].black = black;
+    blocks[t].features = features;
+    // blocks of whole rows, so that every thread writes its own pages
+    blocks[t].first = (long)rows * t / threads * tree->width;
+    blocks[t].last = (long)rows * (t + 1) / threads * tree->width;
+  }
+  // the pixels of every block are touched by its thread first, the tree is
+  // linked by this one as the flat zones of pixels cross the blocks
+  RunBlocks(blocks, thread, threads, TouchRows);
+  // parents have higher indices, so going down every parent is linked already
+  rank[rootIndex] = count;
+  next[rootIndex] = BOTTOM;
+  for (i = rootIndex - 1; i >= 0; i--)
+  {
+    parent = node[i].parent;
+    if (rank[parent] < 0)
+      parent = next[parent];
+    if (!IsLevelRoot(tree, i))
+    {
+      // other nodes only link to their level root
+      rank[i] = -1;
+      next[i] = parent;
+      continue;
+    }
+    // area and salience do not decrease towards the root
+    rank[i] = Rank(attribute == FILTER_AREA ? node[i].area : node[parent].alpha, lambda, count);
+    next[i] = rank[parent] > rank[i] ? parent : next[parent];
+  }
+
+  RunBlocks(blocks, thread, threads, ProfileRows);
+
+  free(thread);
+  free(blocks);
+  free(next);
+  free(rank);
+  return (0);
+#endif
+}
+
+/**
+ * @brief Writes the attribute profiles of SalienceTreeAttributeProfiles to a
+ * memory-mapped file of floats in native byte order.
+ *
+ * @param tree Tree to draw
+ * @param attribute FILTER_AREA or FILTER_SALIENCE
+ * @param lambda Increasing lambdas
+ * @param count Number of lambdas
+ * @param fname Name of the output file
+ * @param threads Number of threads
+ * @return int 0 on success, -1 on failure
+ */
+int WriteAttributeProfiles(SalienceTree *tree, int attribute, double *lambda, int count, char *fname, int threads)
+{
+#ifndef ATTRIBUTE_MEAN
+  fprintf(stderr, "Error: Attribute profiles need a build with the MEAN attribute!");
+  return (-1);
+#else
+  size_t length = (size_t)tree->imgSize * ProfileFeatures(count) * sizeof(float);
+  float *features;
+  int fd, r;
+
+  fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, length) != 0)
+  {
+    fprintf(stderr, "Error: Can't write the profiles: %s !", fname);
+    if (fd >= 0)
+      close(fd);
+    return (-1);
+  }
+  features = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (features == MAP_FAILED)
+  {
+    fprintf(stderr, "Error: Can't map the profiles: %s !", fname);
+    return (-1);
+  }
+  r = SalienceTreeAttributeProfiles(tree, attribute, lambda, count, features, threads);
+  munmap(features, length);
+  return (r);
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef ATTRIBUTE_PROFILE_H
+#define ATTRIBUTE_PROFILE_H
+
+#include "common.h"
+#include "TreeFilter.h"
+#include "../source/SalienceTree.h"
+
+// Number of floats per pixel in a profile file for count lambdas: the filtered
+// value at every lambda followed by the differences between consecutive ones,
+// CHANNELS floats each
+#define ProfileFeatures(count) ((2 * (count) - 1) * CHANNELS)
+
+int SalienceTreeAttributeProfiles(SalienceTree *tree, int attribute, double *lambda, int count, float *features, int threads);
+int WriteAttributeProfiles(SalienceTree *tree, int attribute, double *lambda, int count, char *fname, int threads);
+
+#endif
@@ -14,7 +14,7 @@ double simpleSalience(Pixel p, Pixel q)
   double result = 0;
   int i;
 
-  for (i = 0; i < 3; i++)
+  for (i = 0; i < CHANNELS; i++)
     result += ((double)p[i] - (double)q[i]) * ((double)p[i] - (double)q[i]);
   return sqrt(result);
 }
@@ -32,11 +32,29 @@ double WeightedSalience(Pixel p, Pixel q)
   double result = 0;
   int i;
 
-  for (i = 0; i < 3; i++)
-    result += RGBweight[i] * ((double)p[i] - (double)q[i]) * ((double)p[i] - (double)q[i]);
+  // one channel builds take the same sum, so a gray ppm image read into one
+  // channel weighted like three gets the edge strengths of a 3 channel build
+  for (i = 0; i < CHANNELS; i++)
+    result += ChannelWeight[i] * ((double)p[i] - (double)q[i]) * ((double)p[i] - (double)q[i]);
   return sqrt(result);
 }
 
+/**
+ * @brief Computes the highest edge strength EdgeStrengthX, EdgeStrengthY and
+ * EdgeStrengthZ can return, for a maximal difference in every channel.
+ *
+ * @return double The highest edge strength
+ */
+double MaxEdgeStrength(void)
+{
+  double result = 0;
+  int i;
+
+  for (i = 0; i < CHANNELS; i++)
+    result += ChannelWeight[i];
+  return ((MainEdgeWeight + OrthogonalEdgeWeight) * sqrt(result) * CHANNEL_MAX);
+}
+
 /**
  * @brief Computes the edge strength in the x direction at a given position (x,y)
  * 
@@ -55,12 +73,12 @@ double EdgeStrengthX(Pixel *img, int width, int height, int x, int y)
   // We use the minimum salience between the sourrounding rows at (x-1) and x
   double ygrad = MIN(
     WeightedSalience(
-      img[width * yminus1 + x - 1],
-      img[width * yplus1 + x - 1]
+      img[(Index)width * yminus1 + x - 1],
+      img[(Index)width * yplus1 + x - 1]
     ),
     WeightedSalience(
-      img[width * yminus1 + x],
-      img[width * yplus1 + x]
+      img[(Index)width * yminus1 + x],
+      img[(Index)width * yplus1 + x]
     )
   );
   return (
@@ -68,8 +86,8 @@ double EdgeStrengthX(Pixel *img, int width, int height, int x, int y)
     ygrad + 
     MainEdgeWeight *
     WeightedSalience(
-      img[width * y + x - 1],
-      img[width * y + x]
+      img[(Index)width * y + x - 1],
+      img[(Index)width * y + x]
     )
   );
 }
@@ -92,12 +110,12 @@ double EdgeStrengthY(Pixel *img, int width, int height, int x, int y)
   // We use the minimum salience between the sourrounding columns at (y-1) and y
   double xgrad = MIN(
     WeightedSalience(
-      img[width * y + xplus1],
-      img[width * y + xminus1]
+      img[(Index)width * y + xplus1],
+      img[(Index)width * y + xminus1]
     ),
     WeightedSalience(
-      img[width * (y - 1) + xplus1],
-      img[width * (y - 1) + xminus1]
+      img[(Index)width * (y - 1) + xplus1],
+      img[(Index)width * (y - 1) + xminus1]
     )
   );
   return (
@@ -105,8 +123,60 @@ double EdgeStrengthY(Pixel *img, int width, int height, int x, int y)
     xgrad + 
     MainEdgeWeight *
     WeightedSalience(
-      img[width * (y - 1) + x],
-      img[width * y + x]
+      img[(Index)width * (y - 1) + x],
+      img[(Index)width * y + x]
+    )
+  );
+}
+
+/**
+ * @brief Computes the edge strength in the z direction at a given position (x,y)
+ * between two consecutive slices of a volume. The orthogonal gradient is the
+ * average of the gradients in the x and y direction, each taken as the minimum
+ * over both slices like in EdgeStrengthX and EdgeStrengthY.
+ * 
+ * @param prev Previous slice
+ * @param cur Current slice
+ * @param width of the slices
+ * @param height of the slices
+ * @param x x-coordinate of the position
+ * @param y y-coordinate of the position
+ * @return double The edge strength
+ */
+double EdgeStrengthZ(Pixel *prev, Pixel *cur, int width, int height, int x, int y)
+{
+  int xminus1 = x - (x > 0);
+  int xplus1 = x + (x < width - 1);
+  int yminus1 = y - (y > 0);
+  int yplus1 = y + (y < height - 1);
+
+  double xgrad = MIN(
+    WeightedSalience(
+      prev[(Index)width * y + xplus1],
+      prev[(Index)width * y + xminus1]
+    ),
+    WeightedSalience(
+      cur[(Index)width * y + xplus1],
+      cur[(Index)width * y + xminus1]
+    )
+  );
+  double ygrad = MIN(
+    WeightedSalience(
+      prev[(Index)width * yplus1 + x],
+      prev[(Index)width * yminus1 + x]
+    ),
+    WeightedSalience(
+      cur[(Index)width * yplus1 + x],
+      cur[(Index)width * yminus1 + x]
+    )
+  );
+  return (
+    OrthogonalEdgeWeight *
+    0.5 * (xgrad + ygrad) +
+    MainEdgeWeight *
+    WeightedSalience(
+      prev[(Index)width * y + x],
+      cur[(Index)width * y + x]
     )
   );
-}
\ No newline at end of file
+}
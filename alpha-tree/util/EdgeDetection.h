@@ -5,7 +5,9 @@
 
 double simpleSalience(Pixel p, Pixel q);
 double WeightedSalience(Pixel p, Pixel q);
+double MaxEdgeStrength(void);
 double EdgeStrengthX(Pixel *img, int width, int height, int x, int y);
 double EdgeStrengthY(Pixel *img, int width, int height, int x, int y);
+double EdgeStrengthZ(Pixel *prev, Pixel *cur, int width, int height, int x, int y);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,275 @@
+#include "HierarchyCut.h"
+#include <stdlib.h>
+
+// A level root starts a region at its own alpha and ends it at that of its parent
+typedef struct LevelEvent
+{
+  double alpha;
+  int delta;
+} LevelEvent;
+
+static int CompareEvents(const void *a, const void *b)
+{
+  double alphaA = ((LevelEvent *)a)->alpha, alphaB = ((LevelEvent *)b)->alpha;
+
+  return ((alphaA > alphaB) - (alphaA < alphaB));
+}
+
+/**
+ * @brief Indexes the number of regions of the partition of a tree at every
+ * alpha. Every level root is a region from its own alpha up to the alpha of its
+ * parent, so sorting these events once and adding them up gives the number of
+ * regions at every level.
+ *
+ * @param tree Tree to index
+ * @return HierarchyIndex* Index of the levels of the tree
+ */
+HierarchyIndex *CreateHierarchyIndex(SalienceTree *tree)
+{
+  HierarchyIndex *index = malloc(sizeof(HierarchyIndex));
+  LevelEvent *events = malloc(2 * tree->curSize * sizeof(LevelEvent));
+  Index i, parent;
+  int regions = 0;
+  long e, count = 0;
+
+  if (index == NULL || events == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  for (i = 0; i < tree->curSize; i++)
+  {
+    if (!IsLevelRoot(tree, i))
+      continue;
+    events[count].alpha = tree->node[i].alpha;
+    events[count++].delta = 1;
+    parent = tree->node[i].parent;
+    if (parent != BOTTOM)
+    {
+      events[count].alpha = tree->node[parent].alpha;
+      events[count++].delta = -1;
+    }
+  }
+  qsort(events, count, sizeof(LevelEvent), CompareEvents);
+
+  // every distinct alpha becomes a level, at most one per event
+  index->alpha = malloc(count * sizeof(double));
+  index->regions = malloc(count * sizeof(int));
+  if (index->alpha == NULL || index->regions == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  index->count = 0;
+  for (e = 0; e < count; e++)
+  {
+    regions += events[e].delta;
+    if (e + 1 < count && events[e + 1].alpha == events[e].alpha)
+      continue;
+    index->alpha[index->count] = events[e].alpha;
+    index->regions[index->count++] = regions;
+  }
+  free(events);
+  return (index);
+}
+
+/**
+ * @brief Free memory allocated for the index of a tree
+ */
+void DeleteHierarchyIndex(HierarchyIndex *index)
+{
+  free(index->alpha);
+  free(index->regions);
+  free(index);
+}
+
+/**
+ * @brief Finds the lowest alpha at which the partition has at most k regions,
+ * with a binary search over the levels. The partition has fewer regions when no
+ * level has exactly k.
+ *
+ * @param index Index of the tree
+ * @param k Number of regions
+ * @param regions Set to the number of regions at the returned alpha
+ * @return double Alpha of the cut
+ */
+double HierarchyIndexAlpha(HierarchyIndex *index, int k, int *regions)
+{
+  int low = 0, high = index->count - 1, middle;
+
+  // the number of regions does not increase with alpha
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+    if (index->regions[middle] <= k)
+      high = middle;
+    else
+      low = middle + 1;
+  }
+  *regions = index->regions[low];
+  return (index->alpha[low]);
+}
+
+/**
+ * @brief Labels the pixels with the region of the partition at alpha they belong
+ * to, in one pass from the root down. The regions are numbered 0, 1, ... in the
+ * order in which the pass meets them.
+ *
+ * @param tree Tree to cut
+ * @param alpha Alpha of the cut
+ * @param labels Label of every pixel
+ * @return int Number of regions
+ */
+int SalienceTreeCutLabels(SalienceTree *tree, double alpha, uint32_t *labels)
+{
+  uint32_t *label = malloc(tree->curSize * sizeof(uint32_t));
+  Index i, parent, imgsize = tree->imgSize;
+  int regions = 0;
+
+  if (label == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  // parents have higher indices, so going down every parent is labelled already
+  for (i = tree->curSize - 1; i >= 0; i--)
+  {
+    parent = tree->node[i].parent;
+    if (tree->node[i].alpha > alpha)
+      continue;
+    if (parent == BOTTOM || tree->node[parent].alpha > alpha)
+      label[i] = regions++;
+    else
+      label[i] = label[parent];
+  }
+  for (i = 0; i < imgsize; i++)
+    labels[i] = label[i];
+  free(label);
+  return (regions);
+}
+
+/**
+ * @brief Finds the set of a node with path halving.
+ */
+static Index FindSet(Index *set, Index p)
+{
+  while (set[p] != p)
+  {
+    set[p] = set[set[p]];
+    p = set[p];
+  }
+  return (p);
+}
+
+/**
+ * @brief Renders the tree of an image as an ultrametric contour map: the boundary
+ * between two neighbouring pixels gets the alpha of the lowest node that contains
+ * both, the alpha at which its two sides merge. The map is a grid of
+ * (2 * width + 1) x (2 * height + 1) values in which pixel (x, y) lies at
+ * (2x + 1, 2y + 1) with value 0, the boundaries between pixels lie between them
+ * and every corner between boundaries gets the highest of the boundaries around
+ * it, so that the contours at every alpha are closed. The lowest common ancestors
+ * of all neighbouring pixels are found by Tarjan's offline algorithm in one
+ * depth-first pass over the tree: when a pixel is finished, the set of every
+ * finished neighbour has been joined up to the node in which the two meet.
+ *
+ * @param tree Tree of an image
+ * @param ucm Contour map, (2 * width + 1) * (2 * height + 1) values
+ */
+void SalienceTreeContourMap(SalienceTree *tree, float *ucm)
+{
+  Index imgsize = tree->imgSize;
+  int width = tree->width, height = imgsize / width;
+  Index gridwidth = 2 * width + 1, gridheight = 2 * height + 1;
+  Index *child = malloc(tree->curSize * sizeof(Index));
+  Index *sibling = malloc(tree->curSize * sizeof(Index));
+  Index *set = malloc(tree->curSize * sizeof(Index));
+  Index *ancestor = malloc(tree->curSize * sizeof(Index));
+  Index *stack = malloc(tree->curSize * sizeof(Index));
+  boolean *finished = calloc(imgsize, sizeof(boolean));
+  Index i, u, v, top = 0;
+  int x, y, gx, gy;
+  float value;
+
+  if (child == NULL || sibling == NULL || set == NULL || ancestor == NULL || stack == NULL || finished == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  for (i = 0; i < tree->curSize; i++)
+  {
+    child[i] = BOTTOM;
+    set[i] = ancestor[i] = i;
+  }
+  for (i = tree->curSize - 1; i >= 0; i--)
+  {
+    if (tree->node[i].parent != BOTTOM)
+    {
+      sibling[i] = child[tree->node[i].parent];
+      child[tree->node[i].parent] = i;
+    }
+  }
+  for (i = 0; i < gridwidth * gridheight; i++)
+    ucm[i] = 0;
+
+  stack[0] = tree->curSize - 1;
+  while (top >= 0)
+  {
+    u = stack[top];
+    if (child[u] != BOTTOM)
+    {
+      // descend into the next child
+      v = child[u];
+      child[u] = sibling[v];
+      stack[++top] = v;
+      continue;
+    }
+    top--;
+    if (u < imgsize)
+    {
+      finished[u] = true;
+      x = u % width;
+      y = u / width;
+      // the boundaries to the finished neighbours
+      if (x > 0 && finished[u - 1])
+        ucm[(2 * y + 1) * gridwidth + 2 * x] = tree->node[ancestor[FindSet(set, u - 1)]].alpha;
+      if (x < width - 1 && finished[u + 1])
+        ucm[(2 * y + 1) * gridwidth + 2 * x + 2] = tree->node[ancestor[FindSet(set, u + 1)]].alpha;
+      if (y > 0 && finished[u - width])
+        ucm[2 * y * gridwidth + 2 * x + 1] = tree->node[ancestor[FindSet(set, u - width)]].alpha;
+      if (y < height - 1 && finished[u + width])
+        ucm[(2 * y + 2) * gridwidth + 2 * x + 1] = tree->node[ancestor[FindSet(set, u + width)]].alpha;
+    }
+    if (top >= 0)
+    {
+      // the finished subtree joins the set of its parent
+      v = FindSet(set, stack[top]);
+      set[FindSet(set, u)] = v;
+      ancestor[v] = stack[top];
+    }
+  }
+
+  // close the contours in the corners
+  for (gy = 0; gy < gridheight; gy += 2)
+  {
+    for (gx = 0; gx < gridwidth; gx += 2)
+    {
+      value = 0;
+      if (gx > 0)
+        value = MAX(value, ucm[gy * gridwidth + gx - 1]);
+      if (gx < gridwidth - 1)
+        value = MAX(value, ucm[gy * gridwidth + gx + 1]);
+      if (gy > 0)
+        value = MAX(value, ucm[(gy - 1) * gridwidth + gx]);
+      if (gy < gridheight - 1)
+        value = MAX(value, ucm[(gy + 1) * gridwidth + gx]);
+      ucm[gy * gridwidth + gx] = value;
+    }
+  }
+  free(child);
+  free(sibling);
+  free(set);
+  free(ancestor);
+  free(stack);
+  free(finished);
+}
@@ -0,0 +1,24 @@
+#ifndef HIERARCHY_CUT_H
+#define HIERARCHY_CUT_H
+
+#include <stdint.h>
+#include "common.h"
+#include "../source/SalienceTree.h"
+
+// Number of regions of the partition of a tree at every alpha at which it changes.
+// The partition at alpha consists of the nodes with an alpha of at most alpha
+// of which the parent has a higher alpha.
+typedef struct HierarchyIndex
+{
+  int count;       /* number of levels */
+  double *alpha;   /* increasing */
+  int *regions;    /* regions of the partition from alpha[i] up to alpha[i + 1] */
+} HierarchyIndex;
+
+HierarchyIndex *CreateHierarchyIndex(SalienceTree *tree);
+void DeleteHierarchyIndex(HierarchyIndex *index);
+double HierarchyIndexAlpha(HierarchyIndex *index, int k, int *regions);
+int SalienceTreeCutLabels(SalienceTree *tree, double alpha, uint32_t *labels);
+void SalienceTreeContourMap(SalienceTree *tree, float *ucm);
+
+#endif
@@ -4,6 +4,185 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+
+// Number of pixels converted at once when reading or writing 16-bit samples
+#define PPM_BLOCK 4096
+// Samples of a ppm pixel, builds of one channel read and write gray images
+#define PPM_CHANNELS 3
+
+/**
+ * @brief Reads the part of a ppm header after the signature: comments, the
+ * dimensions and the maximum value, followed by the single whitespace character
+ * that separates the header from binary pixel data.
+ *
+ * @param infile Opened ppm file, positioned after the signature
+ * @param imgwidth Set to the width of the image
+ * @param imgheight Set to the height of the image
+ * @return int The maximum value of the image, 0 if this build can not hold it
+ */
+static int ReadPPMHeader(FILE *infile, int *imgwidth, int *imgheight)
+{
+  int c, maxval = 0;
+
+  // skip comments
+  while (isspace(c = fgetc(infile)))
+    ;
+  while (c == '#')
+  {
+    while ((c = fgetc(infile)) != '\n')
+      ;
+    c = fgetc(infile);
+  }
+  ungetc(c, infile);
+  fscanf(infile, "%d %d %d", imgwidth, imgheight, &maxval);
+  fgetc(infile);
+  if (maxval > CHANNEL_MAX)
+  {
+    fprintf(stderr, "Error: Maximum value %d needs a build with CHANNEL_BITS=16!", maxval);
+    return (0);
+  }
+  if (CHANNELS != PPM_CHANNELS && CHANNELS != 1)
+  {
+    fprintf(stderr, "Error: ppm images have 3 channels, this build expects %d!", CHANNELS);
+    return (0);
+  }
+  return (maxval);
+}
+
+/**
+ * @brief Checks that the pixels of an image can be numbered with the Index type
+ * of this build, with room for the nodes of its tree.
+ *
+ * @return boolean true if the image fits
+ */
+boolean ImageFitsIndex(int imgwidth, int imgheight)
+{
+  if ((long)imgwidth * imgheight <= INDEX_PIXELS_MAX)
+    return (true);
+  fprintf(stderr, "Error: An image of %dx%d pixels needs a build with INDEX_BITS=64!", imgwidth, imgheight);
+  return (false);
+}
+
+/**
+ * @brief Scales a sample of an image with the given maximum value to the range
+ * [0, CHANNEL_MAX] of the build, so that the images written with CHANNEL_MAX
+ * keep the brightness of the input.
+ */
+static inline Channel ScaleSample(long value, int maxval)
+{
+  return ((Channel)((value * CHANNEL_MAX + maxval / 2) / maxval));
+}
+
+/**
+ * @brief Stores the samples of a ppm pixel in a Pixel. Builds of one channel
+ * keep the first of the three equal samples of a gray pixel.
+ *
+ * @param pixel Pixel to store the samples in
+ * @param sample The PPM_CHANNELS samples of the pixel
+ * @param maxval Maximum value of the image
+ * @return boolean false for a color pixel in a build of one channel
+ */
+static inline boolean StorePPMPixel(Channel *pixel, long *sample, int maxval)
+{
+  int j;
+
+  if (CHANNELS == 1 && (sample[1] != sample[0] || sample[2] != sample[0]))
+  {
+    fprintf(stderr, "Error: Builds of one channel only read gray ppm images!");
+    return (false);
+  }
+  for (j = 0; j < CHANNELS; j++)
+    pixel[j] = ScaleSample(sample[j], maxval);
+  return (true);
+}
+
+/**
+ * @brief Reads binary ppm pixel data. Samples of images with a maximum value
+ * above 255 take two bytes, most significant byte first. The samples are scaled
+ * to CHANNEL_MAX.
+ *
+ * @param infile Opened ppm file, positioned at the pixel data
+ * @param pixels Array to read the pixels into
+ * @param count Number of pixels to read
+ * @param maxval Maximum value of the image
+ * @return size_t Number of pixels read
+ */
+static size_t ReadPPMSamples(FILE *infile, Pixel *pixels, size_t count, int maxval)
+{
+#if CHANNEL_BITS == 8 && CHANNELS == PPM_CHANNELS
+  Channel *samples = (Channel *)pixels;
+  size_t done = fread(pixels, sizeof(Pixel), count, infile), i;
+
+  if (maxval != CHANNEL_MAX)
+    for (i = 0; i < done * CHANNELS; i++)
+      samples[i] = ScaleSample(samples[i], maxval);
+  return (done);
+#else
+  ubyte buffer[PPM_BLOCK * PPM_CHANNELS * 2];
+  long sample[PPM_CHANNELS];
+  size_t done, n, i, k;
+  int bytes = (maxval > 255) ? 2 : 1, j;
+
+  for (done = 0; done < count; done += n)
+  {
+    n = MIN(PPM_BLOCK, count - done);
+    if (fread(buffer, PPM_CHANNELS * bytes, n, infile) != n)
+      return (done);
+    for (i = 0; i < n; i++)
+    {
+      for (j = 0; j < PPM_CHANNELS; j++)
+      {
+        k = i * PPM_CHANNELS + j;
+        sample[j] = (bytes == 2) ? (buffer[2 * k] << 8) | buffer[2 * k + 1] : buffer[k];
+      }
+      if (!StorePPMPixel(pixels[done + i], sample, maxval))
+        return (done + i);
+    }
+  }
+  return (done);
+#endif
+}
+
+/**
+ * @brief Writes binary ppm pixel data, in the format ReadPPMSamples reads for
+ * a maximum value of CHANNEL_MAX. Builds of one channel write gray pixels.
+ *
+ * @param outfile Opened output file
+ * @param pixels Pixels to write
+ * @param count Number of pixels to write
+ */
+static void WritePPMSamples(FILE *outfile, Pixel *pixels, size_t count)
+{
+#if CHANNEL_BITS == 8 && CHANNELS == PPM_CHANNELS
+  fwrite(pixels, sizeof(Pixel), count, outfile);
+#else
+  ubyte buffer[PPM_BLOCK * PPM_CHANNELS * 2];
+  Channel sample;
+  size_t done, n, i, k;
+  int j;
+
+  for (done = 0; done < count; done += n)
+  {
+    n = MIN(PPM_BLOCK, count - done);
+    for (i = 0; i < n; i++)
+      for (j = 0; j < PPM_CHANNELS; j++)
+      {
+        sample = pixels[done + i][CHANNELS == 1 ? 0 : j];
+        k = i * PPM_CHANNELS + j;
+        if (CHANNEL_BITS == 8)
+          buffer[k] = sample;
+        else
+        {
+          buffer[2 * k] = sample >> 8;
+          buffer[2 * k + 1] = sample & 0xff;
+        }
+      }
+    fwrite(buffer, PPM_CHANNELS * CHANNEL_BITS / 8, n, outfile);
+  }
+#endif
+}
 
 /**
  * @brief Reads contents of a given ppm image into the global gval Pixel array.
@@ -16,7 +195,8 @@ short ImagePPMAsciiRead(char *fname)
 {
   FILE *infile;
   unsigned long i, j;
-  int c;
+  long sample[PPM_CHANNELS];
+  int c, maxval;
 
   infile = fopen(fname, "r");
   if (infile == NULL)
@@ -24,16 +204,20 @@ short ImagePPMAsciiRead(char *fname)
     fprintf(stderr, "Error: Can't read the ASCII file: %s !", fname);
     return (0);
   }
-  fscanf(infile, "P3\n");
-  // skip comments
-  while ((c = fgetc(infile)) == '#')
-    while ((c = fgetc(infile)) != '\n')
-      ;
-  ungetc(c, infile);
-
-  // scan width and height from ppm and assume color spectrum [0,255]
-  fscanf(infile, "%d %d\n255\n", &width, &height);
-  size = width * height;
+  fscanf(infile, "P3");
+  // scan width and height from ppm, the color spectrum has to fit a Channel
+  maxval = ReadPPMHeader(infile, &width, &height);
+  if (maxval == 0)
+  {
+    fclose(infile);
+    return (0);
+  }
+  if (!ImageFitsIndex(width, height))
+  {
+    fclose(infile);
+    return (0);
+  }
+  size = (Index)width * height;
 
   // allocate space for all pixels in the image
   gval = malloc(size * sizeof(Pixel));
@@ -44,12 +228,19 @@ short ImagePPMAsciiRead(char *fname)
     return (0);
   }
   // read in all pixels from ppm image
-  for (i = 0; i < size; i++)
+  for (i = 0; i < (unsigned long)size; i++)
   {
-    for (j = 0; j < 3; j++)
+    for (j = 0; j < PPM_CHANNELS; j++)
     {
       fscanf(infile, "%d", &c);
-      gval[i][j] = c;
+      sample[j] = c;
+    }
+    if (!StorePPMPixel(gval[i], sample, maxval))
+    {
+      free(gval);
+      gval = NULL;
+      fclose(infile);
+      return (0);
     }
   }
   fclose(infile);
@@ -66,7 +257,7 @@ short ImagePPMAsciiRead(char *fname)
 short ImagePPMBinRead(char *fname)
 {
   FILE *infile;
-  int c, i;
+  int maxval;
 
   infile = fopen(fname, "rb");
   if (infile == NULL)
@@ -74,14 +265,19 @@ short ImagePPMBinRead(char *fname)
     fprintf(stderr, "Error: Can't read the binary file: %s !", fname);
     return (0);
   }
-  fscanf(infile, "P6\n");
-  // skip comments
-  while ((c = fgetc(infile)) == '#')
-    while ((c = fgetc(infile)) != '\n')
-      ;
-  ungetc(c, infile);
-  fscanf(infile, "%d %d\n255\n", &width, &height);
-  size = width * height;
+  fscanf(infile, "P6");
+  maxval = ReadPPMHeader(infile, &width, &height);
+  if (maxval == 0)
+  {
+    fclose(infile);
+    return (0);
+  }
+  if (!ImageFitsIndex(width, height))
+  {
+    fclose(infile);
+    return (0);
+  }
+  size = (Index)width * height;
 
   // allocate space for all pixels in the image
   gval = malloc(size * sizeof(Pixel));
@@ -92,12 +288,159 @@ short ImagePPMBinRead(char *fname)
     return (0);
   }
   // read all the pixels
-  fread(gval, sizeof(Pixel), size, infile);
+  if (ReadPPMSamples(infile, gval, size, maxval) != (size_t)size)
+  {
+    fprintf(stderr, "Error: Can't read the pixels of %s !", fname);
+    free(gval);
+    gval = NULL;
+    fclose(infile);
+    return (0);
+  }
 
   fclose(infile);
   return (1);
 } /* ImagePGMBinRead */
 
+/**
+ * @brief Reads a window of rows of a binary (P6) ppm image without reading
+ * the rest of the file. The global image variables are left untouched so that
+ * several windows of an image that does not fit in memory can be processed.
+ * The window is clipped to the image, firstRow and lastRow are updated accordingly.
+ *
+ * @param fname Path to the ppm image to read
+ * @param firstRow First row of the window
+ * @param lastRow Row after the last row of the window
+ * @param imgwidth Set to the width of the whole image
+ * @param imgheight Set to the height of the whole image
+ * @return Pixel* Newly allocated pixels of the window, NULL on failure
+ */
+Pixel *ImagePPMBinReadRows(char *fname, int *firstRow, int *lastRow, int *imgwidth, int *imgheight)
+{
+  FILE *infile;
+  Pixel *rows;
+  size_t count;
+  char id[4];
+  int maxval;
+
+  infile = fopen(fname, "rb");
+  if (infile == NULL)
+  {
+    fprintf(stderr, "Error: Can't read the binary file: %s !", fname);
+    return (NULL);
+  }
+  // the rows are found by their offset, which only binary images have
+  if (fscanf(infile, "%3s", id) != 1 || strcmp(id, "P6") != 0)
+  {
+    fprintf(stderr, "Error: tiled builds need a P6 image!");
+    fclose(infile);
+    return (NULL);
+  }
+  maxval = ReadPPMHeader(infile, imgwidth, imgheight);
+  if (maxval == 0)
+  {
+    fclose(infile);
+    return (NULL);
+  }
+
+  *firstRow = MAX(*firstRow, 0);
+  *lastRow = MIN(*lastRow, *imgheight);
+  if (*firstRow >= *lastRow)
+  {
+    fprintf(stderr, "Error: The window does not contain any rows of %s !", fname);
+    fclose(infile);
+    return (NULL);
+  }
+  count = (size_t)(*lastRow - *firstRow) * (*imgwidth);
+  rows = malloc(count * sizeof(Pixel));
+  if (rows == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    fclose(infile);
+    return (NULL);
+  }
+  // skip all rows before the window and read the window itself
+  fseeko(infile, (off_t)(*firstRow) * (*imgwidth) * PPM_CHANNELS * (maxval > 255 ? 2 : 1), SEEK_CUR);
+  if (ReadPPMSamples(infile, rows, count, maxval) != count)
+  {
+    fprintf(stderr, "Error: Unexpected end of file: %s !", fname);
+    free(rows);
+    rows = NULL;
+  }
+  fclose(infile);
+  return (rows);
+} /* ImagePPMBinReadRows */
+
+/**
+ * @brief Reads the dimensions of a ppm image from its header only.
+ *
+ * @param fname Path to the ppm file
+ * @param imgwidth Set to the width of the image
+ * @param imgheight Set to the height of the image
+ * @return short 0 on failure, 1 otherwise
+ */
+short ImagePPMSize(char *fname, int *imgwidth, int *imgheight)
+{
+  FILE *infile;
+  char id[4];
+  int maxval;
+
+  infile = fopen(fname, "rb");
+  if (infile == NULL)
+    return (0);
+  if (fscanf(infile, "%3s", id) != 1 || (strcmp(id, "P3") != 0 && strcmp(id, "P6") != 0))
+  {
+    fclose(infile);
+    return (0);
+  }
+  maxval = ReadPPMHeader(infile, imgwidth, imgheight);
+  fclose(infile);
+  return (maxval != 0);
+} /* ImagePPMSize */
+
+/**
+ * @brief Checks whether the three samples of every pixel of a ppm image are
+ * equal, reading the pixels a block at a time without keeping them.
+ *
+ * @param fname Path to the ppm file
+ * @return boolean true if the image is gray, false if it is not or can not be read
+ */
+boolean ImagePPMIsGray(char *fname)
+{
+  FILE *infile;
+  ubyte buffer[PPM_BLOCK * PPM_CHANNELS * 2], *pixel;
+  char id[4];
+  size_t n, i;
+  int imgwidth, imgheight, maxval, bytes, a, b, c;
+  boolean gray = true;
+
+  infile = fopen(fname, "rb");
+  if (infile == NULL)
+    return (false);
+  if (fscanf(infile, "%3s", id) != 1 || (strcmp(id, "P3") != 0 && strcmp(id, "P6") != 0) ||
+      (maxval = ReadPPMHeader(infile, &imgwidth, &imgheight)) == 0)
+  {
+    fclose(infile);
+    return (false);
+  }
+  if (strcmp(id, "P3") == 0)
+  {
+    while (gray && fscanf(infile, "%d %d %d", &a, &b, &c) == 3)
+      gray = (a == b && a == c);
+  }
+  else
+  {
+    bytes = (maxval > 255) ? 2 : 1;
+    while (gray && (n = fread(buffer, PPM_CHANNELS * bytes, PPM_BLOCK, infile)) > 0)
+      for (i = 0; gray && i < n; i++)
+      {
+        pixel = buffer + i * PPM_CHANNELS * bytes;
+        gray = (memcmp(pixel, pixel + bytes, bytes) == 0 && memcmp(pixel, pixel + 2 * bytes, bytes) == 0);
+      }
+  }
+  fclose(infile);
+  return (gray);
+} /* ImagePPMIsGray */
+
 /**
  * @brief Reads contents of a given ppm image
  *
@@ -130,6 +473,33 @@ short ImagePPMRead(char *fname)
   }
 } /* ImagePPMRead */
 
+/**
+ * @brief Writes an array of pixels to a PPM image file.
+ * 
+ * @param fname Name of the output PPM image
+ * @param pixels Pixels of the image
+ * @param imgwidth Width of the image
+ * @param imgheight Height of the image
+ * @return int 0 on success, -1 on failure
+ */
+int ImagePPMBinWritePixels(char *fname, Pixel *pixels, int imgwidth, int imgheight)
+{
+  FILE *outfile;
+
+  outfile = fopen(fname, "wb");
+  if (outfile == NULL)
+  {
+    fprintf(stderr, "Error: Can't write the image: %s !", fname);
+    return (-1);
+  }
+  fprintf(outfile, "P6\n%d %d\n%d\n", imgwidth, imgheight, CHANNEL_MAX);
+
+  WritePPMSamples(outfile, pixels, (size_t)imgwidth * imgheight);
+
+  fclose(outfile);
+  return (0);
+} /* ImagePPMBinWritePixels */
+
 /**
  * @brief Writes the contents of the Pixel array representing the output image
  * to a PPM image file.
@@ -138,6 +508,117 @@ short ImagePPMRead(char *fname)
  * @return int 0 on success, -1 on failure
  */
 int ImagePPMBinWrite(char *fname)
+{
+  return (ImagePPMBinWritePixels(fname, out, width, height));
+} /* ImagePPMBinWrite */
+
+/**
+ * @brief Reads a raw image without header. The image holds CHANNELS bands of
+ * Channel samples in native byte order, the bands can be interleaved by pixel
+ * (RAW_BIP), by line (RAW_BIL) or stored one after the other (RAW_BSQ).
+ * The global image variables are left untouched.
+ *
+ * @param fname Path to the raw image
+ * @param imgwidth Width of the image
+ * @param imgheight Height of the image
+ * @param interleave RAW_BIP, RAW_BIL or RAW_BSQ
+ * @return Pixel* Newly allocated pixels of the image, NULL on failure
+ */
+Pixel *ImageRawReadPixels(char *fname, int imgwidth, int imgheight, int interleave)
+{
+  FILE *infile;
+  Pixel *pixels;
+  Channel *line;
+  size_t read = 0, count = (size_t)imgwidth * imgheight;
+  int b, x, y;
+
+  infile = fopen(fname, "rb");
+  if (infile == NULL)
+  {
+    fprintf(stderr, "Error: Can't read the raw file: %s !", fname);
+    return (NULL);
+  }
+
+  // allocate space for all pixels in the image
+  pixels = malloc(count * sizeof(Pixel));
+  line = malloc(imgwidth * sizeof(Channel));
+  if (pixels == NULL || line == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    free(line);
+    free(pixels);
+    fclose(infile);
+    return (NULL);
+  }
+  if (interleave == RAW_BIP)
+  {
+    read = fread(pixels, sizeof(Pixel), count, infile) * CHANNELS;
+  }
+  else if (interleave == RAW_BIL)
+  {
+    // every row holds one line of each band
+    for (y = 0; y < imgheight; y++)
+      for (b = 0; b < CHANNELS; b++)
+      {
+        read += fread(line, sizeof(Channel), imgwidth, infile);
+        for (x = 0; x < imgwidth; x++)
+          pixels[(Index)y * imgwidth + x][b] = line[x];
+      }
+  }
+  else
+  {
+    // every band is a complete image
+    for (b = 0; b < CHANNELS; b++)
+      for (y = 0; y < imgheight; y++)
+      {
+        read += fread(line, sizeof(Channel), imgwidth, infile);
+        for (x = 0; x < imgwidth; x++)
+          pixels[(Index)y * imgwidth + x][b] = line[x];
+      }
+  }
+  free(line);
+  fclose(infile);
+  if (read != count * CHANNELS)
+  {
+    fprintf(stderr, "Error: %s is smaller than %dx%d pixels of %d bands!", fname, imgwidth, imgheight, CHANNELS);
+    free(pixels);
+    return (NULL);
+  }
+  return (pixels);
+} /* ImageRawReadPixels */
+
+/**
+ * @brief Reads a raw image without header into the global gval Pixel array,
+ * see ImageRawReadPixels for the layout of the file.
+ *
+ * @param fname Path to the raw image
+ * @param imgwidth Width of the image
+ * @param imgheight Height of the image
+ * @param interleave RAW_BIP, RAW_BIL or RAW_BSQ
+ * @return short 0 on failure, 1 otherwise
+ */
+short ImageRawRead(char *fname, int imgwidth, int imgheight, int interleave)
+{
+  if (!ImageFitsIndex(imgwidth, imgheight))
+    return (0);
+  gval = ImageRawReadPixels(fname, imgwidth, imgheight, interleave);
+  if (gval == NULL)
+    return (0);
+  width = imgwidth;
+  height = imgheight;
+  size = (Index)width * height;
+  return (1);
+} /* ImageRawRead */
+
+/**
+ * @brief Writes an array of pixels to a raw file, with the bands interleaved by pixel.
+ * 
+ * @param fname Name of the output raw image
+ * @param pixels Pixels of the image
+ * @param count Number of pixels
+ * @return int 0 on success, -1 on failure
+ */
+int ImageRawWritePixels(char *fname, Pixel *pixels, size_t count)
 {
   FILE *outfile;
 
@@ -147,10 +628,19 @@ int ImagePPMBinWrite(char *fname)
     fprintf(stderr, "Error: Can't write the image: %s !", fname);
     return (-1);
   }
-  fprintf(outfile, "P6\n%d %d\n255\n", width, height);
-
-  fwrite(out, sizeof(Pixel), (size_t)(size), outfile);
-
+  fwrite(pixels, sizeof(Pixel), count, outfile);
   fclose(outfile);
   return (0);
-} /* ImagePPMBinWrite */
\ No newline at end of file
+} /* ImageRawWritePixels */
+
+/**
+ * @brief Writes the contents of the Pixel array representing the output image
+ * to a raw file, with the bands interleaved by pixel.
+ * 
+ * @param fname Name of the output raw image
+ * @return int 0 on success, -1 on failure
+ */
+int ImageRawWrite(char *fname)
+{
+  return (ImageRawWritePixels(fname, out, (size_t)size));
+} /* ImageRawWrite */
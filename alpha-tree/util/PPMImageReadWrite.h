@@ -1,9 +1,26 @@
 #ifndef PPM_IMAGE_READ_WRITE_H
 #define PPM_IMAGE_READ_WRITE_H
 
+#include "common.h"
+#include <stddef.h>
+
+// layouts of the bands in raw images
+#define RAW_BIP 0 /* band interleaved by pixel */
+#define RAW_BIL 1 /* band interleaved by line */
+#define RAW_BSQ 2 /* band sequential */
+
+boolean ImageFitsIndex(int imgwidth, int imgheight);
 short ImagePPMAsciiRead(char *fname);
 short ImagePPMBinRead(char *fname);
 short ImagePPMRead(char *fname);
+short ImagePPMSize(char *fname, int *imgwidth, int *imgheight);
+boolean ImagePPMIsGray(char *fname);
+Pixel *ImagePPMBinReadRows(char *fname, int *firstRow, int *lastRow, int *imgwidth, int *imgheight);
 int ImagePPMBinWrite(char *fname);
+int ImagePPMBinWritePixels(char *fname, Pixel *pixels, int imgwidth, int imgheight);
+short ImageRawRead(char *fname, int imgwidth, int imgheight, int interleave);
+Pixel *ImageRawReadPixels(char *fname, int imgwidth, int imgheight, int interleave);
+int ImageRawWrite(char *fname);
+int ImageRawWritePixels(char *fname, Pixel *pixels, size_t count);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,260 @@
+#include "PageAlloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define GUARD_SIZE 4096
+
+// Mapped arrays start a cache line after the header of their mapping
+#define LARGE_HEADER 64
+typedef struct LargeBlock
+{
+  size_t length;  /* of the mapping that can hold the array and header */
+  size_t mapped;  /* including a guard page */
+} LargeBlock;
+
+/**
+ * @brief Maps a block for at least length bytes in the way hugePages selects.
+ * The length is rounded up to whole huge pages, so that the end of an array is
+ * not left on small pages. Blocks of transparent huge pages end in an
+ * inaccessible guard page, which also keeps the kernel from merging the
+ * mappings of neighbouring arrays so that their pages are reported apart.
+ *
+ * @return LargeBlock* Start of the mapping, NULL on failure
+ */
+static LargeBlock *MapBlock(size_t length)
+{
+  char *block = MAP_FAILED;
+  size_t mapped;
+
+  length = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  mapped = length;
+#ifdef MAP_HUGETLB
+  if (hugePages == HUGE_PAGES_EXPLICIT)
+    block = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (block == MAP_FAILED)
+  {
+    mapped = length + GUARD_SIZE;
+    block = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED)
+      return (NULL);
+    mprotect(block + length, GUARD_SIZE, PROT_NONE);
+#ifdef MADV_HUGEPAGE
+    madvise(block, length, MADV_HUGEPAGE);
+#endif
+  }
+  ((LargeBlock *)block)->length = length;
+  ((LargeBlock *)block)->mapped = mapped;
+  return ((LargeBlock *)block);
+}
+
+/**
+ * @brief Allocates one of the large arrays of a tree or an edge queue: the
+ * nodes, the root array or the queue. These arrays are followed from node to
+ * node in no particular order, so with 4 kB pages most steps also miss the TLB.
+ * With -hugepages they are mapped on 2 MB pages instead, which cover 512 times
+ * as much of the array per TLB entry. Without it they come from malloc.
+ * The pages are placed on the NUMA node of the thread that first writes them,
+ * which is the thread that builds the tree, or the process of a tile.
+ *
+ * @param bytes Size of the array
+ * @return void* The array, exits when there is not enough memory
+ */
+void *LargeAlloc(size_t bytes)
+{
+  char *block;
+
+  if (hugePages == HUGE_PAGES_NONE)
+    block = malloc(bytes);
+  else
+  {
+    block = (char *)MapBlock(bytes + LARGE_HEADER);
+    if (block != NULL)
+      block += LARGE_HEADER;
+  }
+  if (block == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  return (block);
+}
+
+/**
+ * @brief Unmaps the huge pages at the end of a block that a smaller length does
+ * not need any more, the guard page moves down with the end.
+ */
+static void ShrinkBlock(LargeBlock *block, size_t length)
+{
+  size_t guard = block->mapped - block->length;
+
+  length = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  if (length >= block->length)
+    return;
+  munmap((char *)block + length + guard, block->length - length);
+  if (guard > 0)
+    mprotect((char *)block + length, guard, PROT_NONE);
+  block->length = length;
+  block->mapped = length + guard;
+}
+
+/**
+ * @brief Resizes an array allocated by LargeAlloc, keeping its contents.
+ * Mapped arrays that shrink give back their unused huge pages in place.
+ */
+void *LargeRealloc(void *ptr, size_t bytes)
+{
+  char *block;
+  size_t length;
+
+  if (hugePages == HUGE_PAGES_NONE)
+  {
+    block = realloc(ptr, bytes);
+    if (block == NULL)
+    {
+      fprintf(stderr, "Out of memory!");
+      exit(-1);
+    }
+    return (block);
+  }
+  length = ((LargeBlock *)((char *)ptr - LARGE_HEADER))->length;
+  // the rounding up to whole huge pages may leave room already
+  if (bytes + LARGE_HEADER <= length)
+  {
+    ShrinkBlock((LargeBlock *)((char *)ptr - LARGE_HEADER), bytes + LARGE_HEADER);
+    return (ptr);
+  }
+  block = LargeAlloc(bytes);
+  memcpy(block, ptr, length - LARGE_HEADER);
+  LargeFree(ptr);
+  return (block);
+}
+
+/**
+ * @brief Frees an array allocated by LargeAlloc.
+ */
+void LargeFree(void *ptr)
+{
+  LargeBlock *block;
+
+  if (ptr == NULL)
+    return;
+  if (hugePages == HUGE_PAGES_NONE)
+  {
+    free(ptr);
+    return;
+  }
+  block = (LargeBlock *)((char *)ptr - LARGE_HEADER);
+  munmap(block, block->mapped);
+}
+
+/**
+ * @brief Reports the size of the pages of an array allocated by LargeAlloc, as
+ * the kernel lists them for its mapping in /proc/self/smaps: the page size of
+ * the mapping and how much of it is on transparent huge pages.
+ *
+ * @param name Name of the array in the report
+ * @param ptr The array
+ */
+void LargeAllocReport(char *name, void *ptr)
+{
+  FILE *smaps = fopen("/proc/self/smaps", "r");
+  char line[256];
+  unsigned long address = (unsigned long)ptr, start, end;
+  long size = 0, pageSize = 0, hugeSize = 0, value;
+  boolean inside = false;
+
+  if (smaps == NULL)
+    return;
+  while (fgets(line, sizeof(line), smaps) != NULL)
+  {
+    if (sscanf(line, "%lx-%lx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' '))
+    {
+      if (inside)
+        break;
+      inside = start <= address && address < end;
+    }
+    else if (inside && sscanf(line, "Size: %ld kB", &value) == 1)
+      size = value;
+    else if (inside && sscanf(line, "KernelPageSize: %ld kB", &value) == 1)
+      pageSize = value;
+    else if (inside && sscanf(line, "AnonHugePages: %ld kB", &value) == 1)
+      hugeSize = value;
+  }
+  fclose(smaps);
+  fprintf(stderr, "%s: %ld kB mapped in %ld kB pages, %ld kB on transparent huge pages\n", name, size, pageSize, hugeSize);
+}
+
+/**
+ * @brief Opens a counter of this thread in user space, see perf_event_open(2).
+ *
+ * @return int Descriptor of the running counter, -1 when it can not be counted
+ */
+static int OpenCounter(unsigned int type, unsigned long config)
+{
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd >= 0)
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  return (fd);
+}
+
+/**
+ * @brief Starts counting the data TLB load misses and the page faults of this
+ * thread, which show what huge pages save for the arrays of LargeAlloc.
+ */
+void PageCountersStart(PageCounters *counters)
+{
+  counters->tlbMisses = OpenCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                    (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  counters->pageFaults = OpenCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+}
+
+/**
+ * @brief Reads a counter of OpenCounter and closes it.
+ *
+ * @return long long The count, -1 when it was not counted
+ */
+static long long CloseCounter(int fd)
+{
+  long long count = -1;
+
+  if (fd < 0)
+    return (-1);
+  if (read(fd, &count, sizeof(count)) != sizeof(count))
+    count = -1;
+  close(fd);
+  return (count);
+}
+
+/**
+ * @brief Reports the counts since PageCountersStart. The hardware counter of the
+ * TLB is missing in most virtual machines, which is reported as well.
+ *
+ * @param name Name of the counted work in the report
+ * @param counters Counters of PageCountersStart
+ */
+void PageCountersReport(char *name, PageCounters *counters)
+{
+  long long tlbMisses = CloseCounter(counters->tlbMisses), pageFaults = CloseCounter(counters->pageFaults);
+
+  if (tlbMisses >= 0)
+    fprintf(stderr, "%s: %lld dTLB load misses, %lld page faults\n", name, tlbMisses, pageFaults);
+  else
+    fprintf(stderr, "%s: dTLB load misses not counted (no hardware counter), %lld page faults\n", name, pageFaults);
+}
@@ -0,0 +1,26 @@
+#ifndef PAGE_ALLOC_H
+#define PAGE_ALLOC_H
+
+#include <stddef.h>
+#include "common.h"
+
+// how the large arrays of the tree and the edge queue are allocated, see -hugepages
+#define HUGE_PAGES_NONE 0         /* malloc */
+#define HUGE_PAGES_TRANSPARENT 1  /* anonymous mapping advised to use transparent huge pages */
+#define HUGE_PAGES_EXPLICIT 2     /* mapping from the reserved huge pages, transparent when none are left */
+
+// counters of the data TLB misses and page faults of a thread, see -pagestats
+typedef struct PageCounters
+{
+  int tlbMisses;   /* perf_event_open descriptor, -1 when not counted */
+  int pageFaults;
+} PageCounters;
+
+void *LargeAlloc(size_t bytes);
+void *LargeRealloc(void *ptr, size_t bytes);
+void LargeFree(void *ptr);
+void LargeAllocReport(char *name, void *ptr);
+void PageCountersStart(PageCounters *counters);
+void PageCountersReport(char *name, PageCounters *counters);
+
+#endif
@@ -1,110 +1,846 @@
 #include "TreeFilter.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// names of the attributes in a predicate, indexed by FILTER_ALPHA ... FILTER_SALIENCE
+static char *attributeName[FILTER_ATTRIBUTES] = {
+    "alpha", "area", "width", "height", "perimeter", "range", "inertia", "salience"};
 
 /**
- * @brief Sets the color of the out image. The color is set as the average of
- * the pixels contained in its alpha level. The determining factor in this filter
- * is the area of an alpha level. It is constantly compared to the lambda level.
- * 
+ * @brief Finds the node attribute an attribute of a predicate is computed from.
+ *
+ * @return char* Name of the node attribute if this build does not maintain it,
+ * NULL if the attribute can be tested
+ */
+static char *MissingAttribute(int attribute)
+{
+  (void)attribute;
+#ifndef ATTRIBUTE_AREA
+  if (attribute == FILTER_AREA || attribute == FILTER_INERTIA)
+    return ("AREA");
+#endif
+#ifndef ATTRIBUTE_BBOX
+  if (attribute == FILTER_WIDTH || attribute == FILTER_HEIGHT)
+    return ("BBOX");
+#endif
+#ifndef ATTRIBUTE_PERIMETER
+  if (attribute == FILTER_PERIMETER)
+    return ("PERIMETER");
+#endif
+#ifndef ATTRIBUTE_RANGE
+  if (attribute == FILTER_RANGE)
+    return ("RANGE");
+#endif
+#ifndef ATTRIBUTE_MOMENTS
+  if (attribute == FILTER_INERTIA)
+    return ("MOMENTS");
+#endif
+  return (NULL);
+}
+
+static double AlphaValue(SalienceTree *tree, Index i)
+{
+  return (tree->node[i].alpha);
+}
+
+#ifdef ATTRIBUTE_AREA
+static double AreaValue(SalienceTree *tree, Index i)
+{
+  return ((double)tree->node[i].area);
+}
+#endif
+
+#ifdef ATTRIBUTE_BBOX
+static double WidthValue(SalienceTree *tree, Index i)
+{
+  return ((double)(tree->node[i].xmax - tree->node[i].xmin + 1));
+}
+
+static double HeightValue(SalienceTree *tree, Index i)
+{
+  return ((double)(tree->node[i].ymax - tree->node[i].ymin + 1));
+}
+#endif
+
+#ifdef ATTRIBUTE_PERIMETER
+static double PerimeterValue(SalienceTree *tree, Index i)
+{
+  return ((double)tree->node[i].perimeter);
+}
+#endif
+
+#ifdef ATTRIBUTE_RANGE
+static double RangeValue(SalienceTree *tree, Index i)
+{
+  SalienceNode *node = tree->node + i;
+  double value = 0;
+  int j;
+
+  for (j = 0; j < CHANNELS; j++)
+    value = MAX(value, (double)(node->maxPix[j] - node->minPix[j]));
+  return (value);
+}
+#endif
+
+#if defined(ATTRIBUTE_AREA) && defined(ATTRIBUTE_MOMENTS)
+static double InertiaValue(SalienceTree *tree, Index i)
+{
+  SalienceNode *node = tree->node + i;
+  double value = node->sumXX - node->sumX * node->sumX / node->area +
+                 node->sumYY - node->sumY * node->sumY / node->area;
+
+  return (value / ((double)node->area * node->area));
+}
+#endif
+
+static double SalienceValue(SalienceTree *tree, Index i)
+{
+  return (NodeSalience(tree, i));
+}
+
+// functions of the attributes, indexed by FILTER_ALPHA ... FILTER_SALIENCE. The
+// function of a criterion is looked up once, so the filters test every node
+// without going through the attributes this build maintains.
+static AttributeFunction attributeValue[FILTER_ATTRIBUTES] = {
+    [FILTER_ALPHA] = AlphaValue,
+#ifdef ATTRIBUTE_AREA
+    [FILTER_AREA] = AreaValue,
+#endif
+#ifdef ATTRIBUTE_BBOX
+    [FILTER_WIDTH] = WidthValue,
+    [FILTER_HEIGHT] = HeightValue,
+#endif
+#ifdef ATTRIBUTE_PERIMETER
+    [FILTER_PERIMETER] = PerimeterValue,
+#endif
+#ifdef ATTRIBUTE_RANGE
+    [FILTER_RANGE] = RangeValue,
+#endif
+#if defined(ATTRIBUTE_AREA) && defined(ATTRIBUTE_MOMENTS)
+    [FILTER_INERTIA] = InertiaValue,
+#endif
+    [FILTER_SALIENCE] = SalienceValue};
+
+/**
+ * @brief Adds the criterion low <= attribute <= high to a predicate. A criterion
+ * on an attribute that is already tested narrows the existing criterion, so every
+ * attribute is computed at most once per node. The criteria stay sorted by
+ * attribute, which tests the cheap attributes first.
+ *
+ * @param predicate Predicate to add the criterion to
+ * @param attribute One of FILTER_ALPHA ... FILTER_SALIENCE
+ * @param low Smallest value that satisfies the criterion, -HUGE_VAL for none
+ * @param high Largest value that satisfies the criterion, HUGE_VAL for none
+ */
+void FilterPredicateAdd(FilterPredicate *predicate, int attribute, double low, double high)
+{
+  FilterCriterion *criterion = predicate->criterion;
+  int i, j;
+
+  for (i = 0; i < predicate->count && criterion[i].attribute < attribute; i++)
+    ;
+  if (i < predicate->count && criterion[i].attribute == attribute)
+  {
+    criterion[i].low = MAX(criterion[i].low, low);
+    criterion[i].high = MIN(criterion[i].high, high);
+    return;
+  }
+  for (j = predicate->count; j > i; j--)
+    criterion[j] = criterion[j - 1];
+  criterion[i].attribute = attribute;
+  criterion[i].value = attributeValue[attribute];
+  criterion[i].low = low;
+  criterion[i].high = high;
+  predicate->count++;
+}
+
+/**
+ * @brief Finds the attribute with the given name and checks that this build can
+ * test it.
+ *
+ * @param text Name of the attribute, does not have to end after it
+ * @param length Length of the name
+ * @return int One of FILTER_ALPHA ... FILTER_SALIENCE, -1 for an unknown attribute
+ * or one that needs a node attribute this build does not maintain
+ */
+int ParseFilterAttribute(char *text, int length)
+{
+  int attribute;
+
+  for (attribute = 0; attribute < FILTER_ATTRIBUTES; attribute++)
+    if ((int)strlen(attributeName[attribute]) == length && strncmp(text, attributeName[attribute], length) == 0)
+      break;
+  if (attribute == FILTER_ATTRIBUTES)
+  {
+    fprintf(stderr, "Error: Unknown attribute '%.*s'!", length, text);
+    return (-1);
+  }
+  if (MissingAttribute(attribute) != NULL)
+  {
+    fprintf(stderr, "Error: Filtering on %s needs a build with the %s attribute!",
+            attributeName[attribute], MissingAttribute(attribute));
+    return (-1);
+  }
+  return (attribute);
+}
+
+/**
+ * @brief Parses a predicate like "area >= 100 && salience >= 20 && range <= 60".
+ * The criteria are separated by "&&" or "," and compare an attribute to a number
+ * with <, <=, > or >=. Attribute names are those of attributeName.
+ *
+ * @param text Predicate to parse
+ * @param predicate Set to the parsed predicate
+ * @return boolean false if the predicate is invalid or needs an attribute this
+ * build does not maintain
+ */
+boolean ParseFilterPredicate(char *text, FilterPredicate *predicate)
+{
+  char *s = text, *end;
+  int attribute, length;
+  boolean greater, strict;
+  double value;
+
+  predicate->count = 0;
+  while (true)
+  {
+    while (isspace((unsigned char)*s) || *s == '&' || *s == ',')
+      s++;
+    if (*s == '\0')
+      break;
+    for (length = 0; isalpha((unsigned char)s[length]); length++)
+      ;
+    if ((attribute = ParseFilterAttribute(s, length)) < 0)
+      return (false);
+    for (s += length; isspace((unsigned char)*s); s++)
+      ;
+    if (*s != '<' && *s != '>')
+    {
+      fprintf(stderr, "Error: Expected <, <=, > or >= at '%s' in filter '%s'!", s, text);
+      return (false);
+    }
+    greater = (*s++ == '>');
+    strict = (*s != '=');
+    if (!strict)
+      s++;
+    value = strtod(s, &end);
+    if (end == s)
+    {
+      fprintf(stderr, "Error: Expected a number at '%s' in filter '%s'!", s, text);
+      return (false);
+    }
+    s = end;
+    // x > v is x >= the next larger double, so every criterion is a closed interval
+    if (strict)
+      value = nextafter(value, greater ? HUGE_VAL : -HUGE_VAL);
+    if (greater)
+      FilterPredicateAdd(predicate, attribute, value, HUGE_VAL);
+    else
+      FilterPredicateAdd(predicate, attribute, -HUGE_VAL, value);
+  }
+  if (predicate->count == 0)
+  {
+    fprintf(stderr, "Error: Empty filter '%s'!", text);
+    return (false);
+  }
+  return (true);
+}
+
+/**
+ * @brief Parses the name of a decision rule.
+ *
+ * @return int FILTER_DIRECT, FILTER_MIN, FILTER_MAX or FILTER_SUBTRACTIVE, -1 for
+ * an unknown rule
+ */
+int ParseFilterRule(char *text)
+{
+  if (strcmp(text, "direct") == 0)
+    return (FILTER_DIRECT);
+  if (strcmp(text, "min") == 0)
+    return (FILTER_MIN);
+  if (strcmp(text, "max") == 0)
+    return (FILTER_MAX);
+  if (strcmp(text, "subtractive") == 0)
+    return (FILTER_SUBTRACTIVE);
+  fprintf(stderr, "Error: Unknown decision rule '%s'!", text);
+  return (-1);
+}
+
+#ifdef ATTRIBUTE_MEAN
+
+/**
+ * @brief Tests all criteria of a predicate on a node, stopping at the first one
+ * that fails. Must not be called for the root, which has no salience.
+ */
+static inline boolean Satisfies(SalienceTree *tree, Index i, FilterPredicate *predicate)
+{
+  FilterCriterion *criterion = predicate->criterion;
+  double value;
+  int c;
+
+  for (c = 0; c < predicate->count; c++)
+  {
+    value = criterion[c].value(tree, i);
+    if (value < criterion[c].low || value > criterion[c].high)
+      return (false);
+  }
+  return (true);
+}
+
+/**
+ * @brief Sets the filtered flag of every level root that satisfies the predicate
+ * or has a descendant that does, as the max rule needs. Children have lower
+ * indices than their parents, so one pass upwards passes the flag on to all
+ * ancestors.
+ */
+static void MarkMaxRule(SalienceTree *tree, FilterPredicate *predicate)
+{
+  Index i;
+
+  for (i = 0; i < tree->curSize; i++)
+    tree->node[i].filtered = false;
+  for (i = 0; i < tree->curSize - 1; i++)
+  {
+    if (!tree->node[i].filtered && IsLevelRoot(tree, i))
+      tree->node[i].filtered = Satisfies(tree, i, predicate);
+    if (tree->node[i].filtered)
+      tree->node[tree->node[i].parent].filtered = true;
+  }
+}
+
+/**
+ * @brief Copies the outval of the pixel nodes to the out image.
+ */
+static void WriteOutval(SalienceTree *tree, Pixel *out)
+{
+  Index i, imgsize = tree->imgSize;
+  int j;
+
+  for (i = 0; i < imgsize; i++)
+    for (j = 0; j < CHANNELS; j++)
+      out[i][j] = tree->node[i].outval[j];
+}
+
+/**
+ * @brief Sets the out image to black, for parameters that remove every node.
+ */
+static void BlackImage(SalienceTree *tree, Pixel *out)
+{
+  Index i;
+  int j;
+
+  for (i = tree->curSize - 1; i >= 0; i--)
+  {
+    for (j = 0; j < CHANNELS; j++)
+      tree->node[i].outval[j] = 0;
+  }
+  WriteOutval(tree, out);
+}
+
+#endif
+
+/**
+ * @brief Sets the color of the out image from the nodes that are kept by a
+ * predicate on their attributes. All criteria of the predicate are tested in the
+ * same pass from the root down, so a predicate with several criteria costs one
+ * traversal. Kept level roots get the average of their pixels and all other nodes
+ * take the color of their parent. The rule decides which level roots are kept:
+ * FILTER_DIRECT keeps the level roots that satisfy the predicate, FILTER_MIN keeps
+ * those of which also all ancestors are kept and FILTER_MAX keeps those of which
+ * a descendant satisfies the predicate, which takes an extra pass upwards.
+ * FILTER_SUBTRACTIVE decides like FILTER_DIRECT, but a kept level root gets the
+ * color of its parent plus the difference between its own average and that of
+ * its parent level root, so removed levels shift their descendants instead of
+ * leaving a jump. The root is always kept.
+ *
  * @param tree Tree to draw
  * @param out Out image
- * @param lambda user defined parameter
+ * @param predicate Criteria a level root has to satisfy
+ * @param rule Decision rule
  */
-void SalienceTreeAreaFilter(SalienceTree *tree, Pixel *out, int lambda)
+void SalienceTreeAttributeFilter(SalienceTree *tree, Pixel *out, FilterPredicate *predicate, int rule)
 {
-  int i, j, imgsize = tree->maxSize / 2;
-  if (lambda <= imgsize)
+#ifndef ATTRIBUTE_MEAN
+  fprintf(stderr, "Error: The attribute filter needs a build with the MEAN attribute!");
+#else
+  SalienceNode *node, *parent, *level;
+  Index i, root = tree->curSize - 1;
+  int j;
+  boolean levelRoot, kept;
+  double value;
+
+  if (rule == FILTER_MAX)
+    MarkMaxRule(tree, predicate);
+  // set the outval of the last node
+  for (j = 0; j < CHANNELS; j++)
+    tree->node[root].outval[j] = tree->node[root].sumPix[j] / tree->node[root].area;
+  tree->node[root].filtered = true;
+  // set color of all other nodes
+  for (i = root - 1; i >= 0; i--)
   {
-    // set the outval of the last node
-    for (j = 0; j < 3; j++)
+    node = tree->node + i;
+    parent = tree->node + node->parent;
+    levelRoot = IsLevelRoot(tree, i);
+    if (!levelRoot)
+      kept = false;
+    else if (rule == FILTER_MAX)
+      kept = node->filtered;
+    else if (rule == FILTER_MIN)
+      kept = parent->filtered && Satisfies(tree, i, predicate);
+    else
+      kept = Satisfies(tree, i, predicate);
+
+    if (!kept)
     {
-      tree->node[tree->curSize - 1].outval[j] =
-          tree->node[tree->curSize - 1].sumPix[j] / tree->node[tree->curSize - 1].area;
+      // use the parents color, nodes within a level also take over its decision
+      for (j = 0; j < CHANNELS; j++)
+        node->outval[j] = parent->outval[j];
+      node->filtered = levelRoot ? false : parent->filtered;
     }
-    // set color of all other nodes
-    for (i = tree->curSize - 2; i >= 0; i--)
+    else if (rule == FILTER_SUBTRACTIVE)
     {
-      // check if we are dealing with the level root and if it has the right area
-      if (IsLevelRoot(tree, i) && (tree->node[i].area >= lambda))
+      level = tree->node + Par(tree, i);
+      for (j = 0; j < CHANNELS; j++)
       {
-        // set the color of the level root
-        for (j = 0; j < 3; j++)
-          tree->node[i].outval[j] = tree->node[i].sumPix[j] / tree->node[i].area;
-      }
-      else
-      {
-        // use the parents color
-        for (j = 0; j < 3; j++)
-          tree->node[i].outval[j] = tree->node[tree->node[i].parent].outval[j];
+        value = parent->outval[j] + node->sumPix[j] / node->area - level->sumPix[j] / level->area;
+        node->outval[j] = value < 0 ? 0 : (value > CHANNEL_MAX ? CHANNEL_MAX : value);
       }
+      node->filtered = true;
     }
-  }
-  else
-  {
-    // if lambda is larger than the image size we get a black image
-    for (i = tree->curSize - 1; i >= 0; i--)
+    else
     {
-      for (j = 0; j < 3; j++)
-        tree->node[i].outval[j] = 0;
+      // set the color of the level root
+      for (j = 0; j < CHANNELS; j++)
+        node->outval[j] = node->sumPix[j] / node->area;
+      node->filtered = true;
     }
   }
-  // set colors of the out image
-  for (i = 0; i < imgsize; i++)
-    for (j = 0; j < 3; j++)
-      out[i][j] = tree->node[i].outval[j];
+  WriteOutval(tree, out);
+#endif
 }
 
+/**
+ * @brief Sets the color of the out image. The color is set as the average of
+ * the pixels contained in its alpha level. The determining factor in this filter
+ * is the area of an alpha level. It is constantly compared to the lambda level.
+ *
+ * @param tree Tree to draw
+ * @param out Out image
+ * @param lambda user defined parameter
+ */
+void SalienceTreeAreaFilter(SalienceTree *tree, Pixel *out, int lambda)
+{
+#ifndef ATTRIBUTE_MEAN
+  fprintf(stderr, "Error: The area filter needs a build with the AREA and MEAN attributes!");
+#else
+  FilterPredicate predicate = {0};
 
+  // if lambda is larger than the image size we get a black image
+  if (lambda > tree->imgSize)
+  {
+    BlackImage(tree, out);
+    return;
+  }
+  FilterPredicateAdd(&predicate, FILTER_AREA, (double)lambda, HUGE_VAL);
+  SalienceTreeAttributeFilter(tree, out, &predicate, FILTER_DIRECT);
+#endif
+}
 
 /**
  * @brief Sets the color of the out image. The color is set as the average of
  * the pixels contained in its alpha level. The determining factor in this filter
  * is the salience of the nodes. It is constantly compared to the lambda level.
  * The node salience is the alpha level of its parent.
- * 
+ *
  * @param tree Tree to draw
  * @param out Out image
  * @param lambda user defined parameter
  */
 void SalienceTreeSalienceFilter(SalienceTree *tree, Pixel *out, double lambda)
 {
-  int i, j, imgsize = tree->maxSize / 2;
-  if (lambda <= tree->node[tree->curSize - 1].alpha)
+#ifndef ATTRIBUTE_MEAN
+  fprintf(stderr, "Error: The salience filter needs a build with the MEAN attribute!");
+#else
+  FilterPredicate predicate = {0};
+
+  // if lambda is larger than the root alpha we get a black image
+  if (lambda > tree->node[tree->curSize - 1].alpha)
+  {
+    BlackImage(tree, out);
+    return;
+  }
+  FilterPredicateAdd(&predicate, FILTER_SALIENCE, lambda, HUGE_VAL);
+  SalienceTreeAttributeFilter(tree, out, &predicate, FILTER_DIRECT);
+#endif
+}
+
+#ifdef ATTRIBUTE_MEAN
+
+// kept node of every node passed by SalienceTreeRegionFilter, open addressing
+typedef struct RegionMemo
+{
+  int capacity;  /* power of two */
+  int count;
+  Index *key;    /* node, BOTTOM for empty slots */
+  Index *kept;
+} RegionMemo;
+
+/**
+ * @brief Finds the slot of a node in a memo, either the slot holding it or the
+ * empty slot where it belongs. The capacity is a power of two.
+ */
+static int MemoSlot(RegionMemo *memo, Index node)
+{
+  unsigned int slot = ((unsigned int)node * 2654435761u) & (memo->capacity - 1);
+
+  while (memo->key[slot] != BOTTOM && memo->key[slot] != node)
+    slot = (slot + 1) & (memo->capacity - 1);
+  return (slot);
+}
+
+/**
+ * @brief Stores the kept node of a node in a memo, doubling the memo when it
+ * gets half full.
+ */
+static void MemoStore(RegionMemo *memo, Index node, Index kept)
+{
+  RegionMemo larger;
+  int i, slot;
+
+  if (2 * (memo->count + 1) > memo->capacity)
   {
-    // set the outval of the last node
-    for (j = 0; j < 3; j++)
+    larger.capacity = 2 * memo->capacity;
+    larger.count = 0;
+    larger.key = malloc(larger.capacity * sizeof(Index));
+    larger.kept = malloc(larger.capacity * sizeof(Index));
+    if (larger.key == NULL || larger.kept == NULL)
     {
-      tree->node[tree->curSize - 1].outval[j] =
-          tree->node[tree->curSize - 1].sumPix[j] / tree->node[tree->curSize - 1].area;
+      fprintf(stderr, "Out of memory!");
+      exit(-1);
     }
-    // set color of all other nodes
-    for (i = tree->curSize - 2; i >= 0; i--)
+    for (i = 0; i < larger.capacity; i++)
+      larger.key[i] = BOTTOM;
+    for (i = 0; i < memo->capacity; i++)
+      if (memo->key[i] != BOTTOM)
+        MemoStore(&larger, memo->key[i], memo->kept[i]);
+    free(memo->key);
+    free(memo->kept);
+    *memo = larger;
+  }
+  slot = MemoSlot(memo, node);
+  if (memo->key[slot] == BOTTOM)
+    memo->count++;
+  memo->key[slot] = node;
+  memo->kept[slot] = kept;
+}
+
+#endif
+
+/**
+ * @brief Renders a rectangle of the output of SalienceTreeAttributeFilter with
+ * the direct rule without filtering the whole tree. Every pixel of the rectangle
+ * takes the average of the nearest ancestor that is a level root satisfying the
+ * predicate, or of the root. The kept node found for every node on the way up is
+ * remembered in a hash table, so pixels in the same region stop at the first
+ * node a neighbour has passed already and the work depends on the size of the
+ * rectangle, not of the image. The rectangle is clipped to the image.
+ *
+ * @param tree Tree to draw
+ * @param view Output of width * height pixels, row after row
+ * @param x Column of the top left corner of the rectangle
+ * @param y Row of the top left corner of the rectangle
+ * @param width of the rectangle
+ * @param height of the rectangle
+ * @param predicate Criteria a level root has to satisfy
+ */
+void SalienceTreeRegionFilter(SalienceTree *tree, Pixel *view, int x, int y, int width, int height, FilterPredicate *predicate)
+{
+#ifndef ATTRIBUTE_MEAN
+  fprintf(stderr, "Error: The region filter needs a build with the MEAN attribute!");
+#else
+  RegionMemo memo;
+  SalienceNode *node;
+  int imgwidth = tree->width, imgheight = tree->imgSize / tree->width;
+  Index root = tree->curSize - 1, *path, i, kept;
+  int j, depth, pathSize = 64, slot, vx, vy;
+
+  memo.capacity = 1024;
+  memo.count = 0;
+  memo.key = malloc(memo.capacity * sizeof(Index));
+  memo.kept = malloc(memo.capacity * sizeof(Index));
+  path = malloc(pathSize * sizeof(Index));
+  if (memo.key == NULL || memo.kept == NULL || path == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  for (i = 0; i < memo.capacity; i++)
+    memo.key[i] = BOTTOM;
+
+  for (vy = 0; vy < height; vy++)
+  {
+    for (vx = 0; vx < width; vx++)
     {
-      // check if we are dealing with the level root and if it has the right salience
-      if (IsLevelRoot(tree, i) && (NodeSalience(tree, i) >= lambda))
+      if (x + vx < 0 || x + vx >= imgwidth || y + vy < 0 || y + vy >= imgheight)
       {
-        // set the color of the level root
-        for (j = 0; j < 3; j++)
-          tree->node[i].outval[j] = tree->node[i].sumPix[j] / tree->node[i].area;
+        for (j = 0; j < CHANNELS; j++)
+          view[(Index)vy * width + vx][j] = 0;
+        continue;
       }
-      else
+      // walk up to a remembered node or a kept one
+      i = (Index)(y + vy) * imgwidth + x + vx;
+      depth = 0;
+      while (true)
       {
-        // use parents color
-        for (j = 0; j < 3; j++)
-          tree->node[i].outval[j] = tree->node[tree->node[i].parent].outval[j];
+        slot = MemoSlot(&memo, i);
+        if (memo.key[slot] == i)
+        {
+          kept = memo.kept[slot];
+          break;
+        }
+        if (i == root || (IsLevelRoot(tree, i) && Satisfies(tree, i, predicate)))
+        {
+          kept = i;
+          MemoStore(&memo, i, kept);
+          break;
+        }
+        if (depth == pathSize)
+        {
+          pathSize *= 2;
+          path = realloc(path, pathSize * sizeof(Index));
+          if (path == NULL)
+          {
+            fprintf(stderr, "Out of memory!");
+            exit(-1);
+          }
+        }
+        path[depth++] = i;
+        i = tree->node[i].parent;
       }
+      while (depth > 0)
+        MemoStore(&memo, path[--depth], kept);
+      node = tree->node + kept;
+      for (j = 0; j < CHANNELS; j++)
+        view[(Index)vy * width + vx][j] = node->sumPix[j] / node->area;
+    }
+  }
+  free(path);
+  free(memo.key);
+  free(memo.kept);
+#endif
+}
+
+/**
+ * @brief Renders a rectangle of the output of SalienceTreeSalienceFilter, see
+ * SalienceTreeRegionFilter.
+ *
+ * @param tree Tree to draw
+ * @param view Output of width * height pixels, row after row
+ * @param x Column of the top left corner of the rectangle
+ * @param y Row of the top left corner of the rectangle
+ * @param width of the rectangle
+ * @param height of the rectangle
+ * @param lambda user defined parameter
+ */
+void SalienceTreeSalienceRegion(SalienceTree *tree, Pixel *view, int x, int y, int width, int height, double lambda)
+{
+  FilterPredicate predicate = {0};
+
+  // if lambda is larger than the root alpha we get a black image
+  if (lambda > tree->node[tree->curSize - 1].alpha)
+  {
+    memset(view, 0, (size_t)width * height * sizeof(Pixel));
+    return;
+  }
+  FilterPredicateAdd(&predicate, FILTER_SALIENCE, lambda, HUGE_VAL);
+  SalienceTreeRegionFilter(tree, view, x, y, width, height, &predicate);
+}
+
+/**
+ * @brief Parses the attribute and lambdas of a pattern spectrum, like
+ * "area:4,16,64,256".
+ *
+ * @param text Spectrum to parse
+ * @return PatternSpectrum* Spectrum with all bins empty, NULL if the text is invalid
+ */
+PatternSpectrum *ParsePatternSpectrum(char *text)
+{
+  PatternSpectrum *spectrum;
+  char *s = strchr(text, ':'), *end;
+  int attribute, k;
+
+  if (s == NULL)
+  {
+    fprintf(stderr, "Error: Expected <attribute>:<lambda>,... in spectrum '%s'!", text);
+    return (NULL);
+  }
+  if ((attribute = ParseFilterAttribute(text, s - text)) < 0)
+    return (NULL);
+  spectrum = malloc(sizeof(PatternSpectrum));
+  if (spectrum == NULL)
+  {
+    fprintf(stderr, "Error: Not enough memory for spectrum '%s'!", text);
+    return (NULL);
+  }
+  spectrum->attribute = attribute;
+  spectrum->count = 1;
+  for (end = s; *end != '\0'; end++)
+    if (*end == ',')
+      spectrum->count++;
+  spectrum->lambda = malloc(spectrum->count * sizeof(double));
+  spectrum->nodes = calloc(spectrum->count + 1, sizeof(long));
+  spectrum->volume = calloc(spectrum->count + 1, sizeof(double));
+  if (spectrum->lambda == NULL || spectrum->nodes == NULL || spectrum->volume == NULL)
+  {
+    fprintf(stderr, "Error: Not enough memory for spectrum '%s'!", text);
+    DeletePatternSpectrum(spectrum);
+    return (NULL);
+  }
+  for (k = 0, s++; k < spectrum->count; k++, s = end + 1)
+  {
+    spectrum->lambda[k] = strtod(s, &end);
+    if (end == s || (*end != ',' && *end != '\0') || (k > 0 && spectrum->lambda[k] <= spectrum->lambda[k - 1]))
+    {
+      fprintf(stderr, "Error: Expected increasing lambdas at '%s' in spectrum '%s'!", s, text);
+      DeletePatternSpectrum(spectrum);
+      return (NULL);
+    }
+  }
+  return (spectrum);
+}
+
+/**
+ * @brief Free memory allocated for a pattern spectrum
+ */
+void DeletePatternSpectrum(PatternSpectrum *spectrum)
+{
+  free(spectrum->lambda);
+  free(spectrum->nodes);
+  free(spectrum->volume);
+  free(spectrum);
+}
+
+/**
+ * @brief Computes the pattern spectra of several attributes in one pass over the
+ * tree, instead of filtering at every lambda and comparing the images. Every level
+ * root below the root adds its area times its contrast, the sum over the channels
+ * of the difference between its average and that of its parent level root, to the
+ * bin of its attribute value in every spectrum. The bin is found by a binary search
+ * over the lambdas.
+ *
+ * @param tree Tree to measure
+ * @param spectra Spectra to fill, bins that were filled before are cleared
+ * @param count Number of spectra
+ */
+void SalienceTreePatternSpectra(SalienceTree *tree, PatternSpectrum **spectra, int count)
+{
+#ifndef ATTRIBUTE_MEAN
+  fprintf(stderr, "Error: Pattern spectra need a build with the MEAN attribute!");
+#else
+  SalienceNode *node, *parent;
+  AttributeFunction *function = malloc(count * sizeof(AttributeFunction));
+  Index i;
+  int j, k, low, high, middle;
+  double contrast, volume, value;
+
+  if (function == NULL)
+  {
+    fprintf(stderr, "Out of memory!");
+    exit(-1);
+  }
+  for (k = 0; k < count; k++)
+  {
+    function[k] = attributeValue[spectra[k]->attribute];
+    memset(spectra[k]->nodes, 0, (spectra[k]->count + 1) * sizeof(long));
+    memset(spectra[k]->volume, 0, (spectra[k]->count + 1) * sizeof(double));
+  }
+  for (i = tree->curSize - 2; i >= 0; i--)
+  {
+    if (!IsLevelRoot(tree, i))
+      continue;
+    node = tree->node + i;
+    parent = tree->node + Par(tree, i);
+    contrast = 0;
+    for (j = 0; j < CHANNELS; j++)
+      contrast += fabs(node->sumPix[j] / node->area - parent->sumPix[j] / parent->area);
+    volume = node->area * contrast;
+    for (k = 0; k < count; k++)
+    {
+      // the bin is the number of lambdas that are not larger than the value
+      value = function[k](tree, i);
+      low = 0;
+      high = spectra[k]->count;
+      while (low < high)
+      {
+        middle = (low + high) / 2;
+        if (spectra[k]->lambda[middle] <= value)
+          low = middle + 1;
+        else
+          high = middle;
+      }
+      spectra[k]->nodes[low]++;
+      spectra[k]->volume[low] += volume;
+    }
+  }
+  free(function);
+#endif
+}
+
+/**
+ * @brief Writes pattern spectra as CSV when the file name ends in ".csv", with
+ * one line "attribute,lower,upper,nodes,volume" per bin, and as a binary file
+ * otherwise. The binary file holds SPECTRUM_FILE_MAGIC and the number of spectra
+ * as ints, followed for every spectrum by the attribute and the number of lambdas
+ * as ints, the lambdas as doubles, the node counts of the bins as longs and the
+ * volumes of the bins as doubles, all in native byte order.
+ *
+ * @param fname Name of the output file
+ * @param spectra Spectra to write
+ * @param count Number of spectra
+ * @return int 0 on success, -1 on failure
+ */
+int WritePatternSpectra(char *fname, PatternSpectrum **spectra, int count)
+{
+  FILE *outfile;
+  int k, b, magic = SPECTRUM_FILE_MAGIC;
+  size_t length = strlen(fname);
+  PatternSpectrum *spectrum;
+
+  outfile = fopen(fname, "wb");
+  if (outfile == NULL)
+  {
+    fprintf(stderr, "Error: Can't write the spectrum: %s !", fname);
+    return (-1);
+  }
+  if (length >= 4 && strcmp(fname + length - 4, ".csv") == 0)
+  {
+    fprintf(outfile, "attribute,lower,upper,nodes,volume\n");
+    for (k = 0; k < count; k++)
+    {
+      spectrum = spectra[k];
+      for (b = 0; b <= spectrum->count; b++)
+        fprintf(outfile, "%s,%g,%g,%ld,%.17g\n", attributeName[spectrum->attribute],
+                b == 0 ? -HUGE_VAL : spectrum->lambda[b - 1],
+                b == spectrum->count ? HUGE_VAL : spectrum->lambda[b],
+                spectrum->nodes[b], spectrum->volume[b]);
     }
   }
   else
   {
-    // if lambda is larger than the root alpha we get a black image
-    for (i = tree->curSize - 1; i >= 0; i--)
+    fwrite(&magic, sizeof(int), 1, outfile);
+    fwrite(&count, sizeof(int), 1, outfile);
+    for (k = 0; k < count; k++)
     {
-      for (j = 0; j < 3; j++)
-        tree->node[i].outval[j] = 0;
+      spectrum = spectra[k];
+      fwrite(&spectrum->attribute, sizeof(int), 1, outfile);
+      fwrite(&spectrum->count, sizeof(int), 1, outfile);
+      fwrite(spectrum->lambda, sizeof(double), spectrum->count, outfile);
+      fwrite(spectrum->nodes, sizeof(long), spectrum->count + 1, outfile);
+      fwrite(spectrum->volume, sizeof(double), spectrum->count + 1, outfile);
     }
   }
-  // set colors of the out image
-  for (i = 0; i < imgsize; i++)
-    for (j = 0; j < 3; j++)
-      out[i][j] = tree->node[i].outval[j];
+  fclose(outfile);
+  return (0);
 }
@@ -7,7 +7,69 @@
 #define Par(tree, p) LevelRoot(tree, tree->node[p].parent)
 #define NodeSalience(tree, p) (tree->node[Par(tree, p)].alpha)
 
+// attributes a filter criterion can test, in the order they are tested, cheapest first
+#define FILTER_ALPHA 0     /* alpha of the node */
+#define FILTER_AREA 1      /* number of pixels, needs AREA */
+#define FILTER_WIDTH 2     /* width of the bounding box, needs BBOX */
+#define FILTER_HEIGHT 3    /* height of the bounding box, needs BBOX */
+#define FILTER_PERIMETER 4 /* needs PERIMETER */
+#define FILTER_RANGE 5     /* largest difference between the pixel values of a channel, needs RANGE */
+#define FILTER_INERTIA 6   /* moment of inertia divided by area squared, needs MOMENTS */
+#define FILTER_SALIENCE 7  /* alpha of the parent */
+#define FILTER_ATTRIBUTES 8
+
+// decision rules for the nodes that do not satisfy the predicate, see SalienceTreeAttributeFilter
+#define FILTER_DIRECT 0
+#define FILTER_MIN 1
+#define FILTER_MAX 2
+#define FILTER_SUBTRACTIVE 3
+
+// computes an attribute of a node from the attributes kept in the tree
+typedef double (*AttributeFunction)(SalienceTree *tree, Index i);
+
+// every criterion keeps the attribute within [low, high]
+typedef struct FilterCriterion
+{
+  int attribute;
+  AttributeFunction value; /* function of the attribute, set by FilterPredicateAdd */
+  double low, high;
+} FilterCriterion;
+
+// conjunction of criteria with at most one criterion per attribute
+typedef struct FilterPredicate
+{
+  int count;
+  FilterCriterion criterion[FILTER_ATTRIBUTES];
+} FilterPredicate;
+
+// Magic number at the start of a binary pattern spectrum file ("PSP1")
+#define SPECTRUM_FILE_MAGIC 0x31505350
+
+// Pattern spectrum of one attribute. A level root is in bin k if lambda[k - 1] <=
+// attribute < lambda[k], bin 0 has no lower and bin count no upper bound. Bin k
+// holds what a filter keeping attribute >= lambda[k] removes from the output of
+// one keeping attribute >= lambda[k - 1].
+typedef struct PatternSpectrum
+{
+  int attribute;   /* one of FILTER_ALPHA ... FILTER_SALIENCE */
+  int count;       /* number of lambdas, the spectrum has count + 1 bins */
+  double *lambda;  /* increasing */
+  long *nodes;     /* level roots in every bin */
+  double *volume;  /* area times contrast in every bin */
+} PatternSpectrum;
+
+int ParseFilterAttribute(char *text, int length);
+void FilterPredicateAdd(FilterPredicate *predicate, int attribute, double low, double high);
+boolean ParseFilterPredicate(char *text, FilterPredicate *predicate);
+int ParseFilterRule(char *text);
+void SalienceTreeAttributeFilter(SalienceTree *tree, Pixel *out, FilterPredicate *predicate, int rule);
 void SalienceTreeAreaFilter(SalienceTree *tree, Pixel *out, int lambda);
 void SalienceTreeSalienceFilter(SalienceTree *tree, Pixel *out, double lambda);
+void SalienceTreeRegionFilter(SalienceTree *tree, Pixel *view, int x, int y, int width, int height, FilterPredicate *predicate);
+void SalienceTreeSalienceRegion(SalienceTree *tree, Pixel *view, int x, int y, int width, int height, double lambda);
+PatternSpectrum *ParsePatternSpectrum(char *text);
+void DeletePatternSpectrum(PatternSpectrum *spectrum);
+void SalienceTreePatternSpectra(SalienceTree *tree, PatternSpectrum **spectra, int count);
+int WritePatternSpectra(char *fname, PatternSpectrum **spectra, int count);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,483 @@
+#include "TreeServer.h"
+#include "PPMImageReadWrite.h"
+#include "EdgeDetection.h"
+#include "TreeFilter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// longest request line and most lambdas in one render request
+#define REQUEST_MAX 4096
+#define LAMBDAS_MAX 64
+
+// the cache, guarded by cacheLock
+static TreeEntry **cache = NULL;
+static int cacheCount = 0, cacheCapacity = 0, cacheSlots = 0;
+static long requestCount = 0;
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+// trees are built one at a time, the build uses the global image variables
+static pthread_mutex_t buildLock = PTHREAD_MUTEX_INITIALIZER;
+// latency histogram, guarded by statsLock
+static long latency[LATENCY_BINS];
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Prepares a tree to be read by several threads at once. The filters
+ * find the level root of a parent with LevelRoot, which shortens the path it
+ * follows. Once every parent is a level root there is nothing left to shorten
+ * and LevelRoot no longer writes to the tree. The parent of a node within a
+ * level becomes its level root, which has the same alpha, so the filters give
+ * the same output. Going down from the root every parent is done already.
+ *
+ * @param tree Tree to prepare
+ */
+void SharedTree(SalienceTree *tree)
+{
+  Index i;
+
+  for (i = tree->curSize - 2; i >= 0; i--)
+    tree->node[i].parent = LevelRoot(tree, tree->node[i].parent);
+}
+
+/**
+ * @brief Frees a cache entry and its tree.
+ */
+static void DeleteEntry(TreeEntry *entry)
+{
+  pthread_mutex_destroy(&entry->filterLock);
+  DeleteTree(entry->tree);
+  free(entry->path);
+  free(entry);
+}
+
+/**
+ * @brief Finds the tree of an image in the cache. Must hold cacheLock. An image
+ * that is rewritten within the same second with the same size keeps its tree.
+ */
+static TreeEntry *FindEntry(char *path, struct stat *status, double lambdamin)
+{
+  int i;
+
+  for (i = 0; i < cacheCount; i++)
+  {
+    if (strcmp(cache[i]->path, path) == 0 && cache[i]->lambdamin == lambdamin &&
+        cache[i]->mtime == (long)status->st_mtime && cache[i]->fsize == (long)status->st_size)
+      return (cache[i]);
+  }
+  return (NULL);
+}
+
+/**
+ * @brief Evicts the least recently used trees that are not in use until the
+ * cache fits its capacity. Must hold cacheLock.
+ */
+static void EvictEntries(void)
+{
+  int i, oldest;
+
+  while (cacheCount > cacheCapacity)
+  {
+    oldest = -1;
+    for (i = 0; i < cacheCount; i++)
+      if (cache[i]->users == 0 && (oldest < 0 || cache[i]->lastUse < cache[oldest]->lastUse))
+        oldest = i;
+    // all trees are in use, the last user evicts them
+    if (oldest < 0)
+      return;
+    DeleteEntry(cache[oldest]);
+    cache[oldest] = cache[--cacheCount];
+  }
+}
+
+/**
+ * @brief Gets the tree of an image from the cache, building it when it is not
+ * there. The tree is in use until ReleaseEntry.
+ *
+ * @param path Path to the ppm image
+ * @param lambdamin Lambdamin of the tree
+ * @return TreeEntry* The entry of the tree, NULL if the image can not be read or
+ * its tree can not be built
+ */
+static TreeEntry *AcquireEntry(char *path, double lambdamin)
+{
+  TreeEntry *entry;
+  struct stat status;
+
+  if (stat(path, &status) != 0)
+    return (NULL);
+  pthread_mutex_lock(&cacheLock);
+  entry = FindEntry(path, &status, lambdamin);
+  if (entry == NULL)
+  {
+    // a request waiting for the same tree finds it once the build is done
+    pthread_mutex_unlock(&cacheLock);
+    pthread_mutex_lock(&buildLock);
+    pthread_mutex_lock(&cacheLock);
+    entry = FindEntry(path, &status, lambdamin);
+    if (entry == NULL)
+    {
+      pthread_mutex_unlock(&cacheLock);
+      if (ImagePPMRead(path))
+      {
+        entry = malloc(sizeof(TreeEntry));
+        if (entry == NULL || (entry->path = strdup(path)) == NULL)
+        {
+          fprintf(stderr, "Out of memory!");
+          exit(-1);
+        }
+        entry->tree = MakeSalienceTree(gval, width, height, lambdamin);
+        free(gval);
+        gval = NULL;
+      }
+      if (entry != NULL && entry->tree == NULL)
+      {
+        free(entry->path);
+        free(entry);
+        entry = NULL;
+      }
+      else if (entry != NULL)
+      {
+        if (compactTree)
+          CompactSalienceTree(entry->tree);
+        SharedTree(entry->tree);
+        entry->mtime = (long)status.st_mtime;
+        entry->fsize = (long)status.st_size;
+        entry->lambdamin = lambdamin;
+        entry->users = 0;
+        pthread_mutex_init(&entry->filterLock, NULL);
+      }
+      pthread_mutex_lock(&cacheLock);
+      if (entry != NULL)
+      {
+        // the cache only outgrows its capacity while all trees are in use
+        if (cacheCount == cacheSlots)
+        {
+          cacheSlots *= 2;
+          cache = realloc(cache, cacheSlots * sizeof(TreeEntry *));
+          if (cache == NULL)
+          {
+            fprintf(stderr, "Out of memory!");
+            exit(-1);
+          }
+        }
+        cache[cacheCount++] = entry;
+      }
+    }
+    pthread_mutex_unlock(&buildLock);
+  }
+  if (entry != NULL)
+  {
+    entry->users++;
+    entry->lastUse = ++requestCount;
+    EvictEntries();
+  }
+  pthread_mutex_unlock(&cacheLock);
+  return (entry);
+}
+
+/**
+ * @brief Ends the use of a tree, evicting it when the cache got too full while
+ * it was in use.
+ */
+static void ReleaseEntry(TreeEntry *entry)
+{
+  pthread_mutex_lock(&cacheLock);
+  entry->users--;
+  EvictEntries();
+  pthread_mutex_unlock(&cacheLock);
+}
+
+/**
+ * @brief Writes all of a buffer to a socket.
+ */
+static boolean SendAll(int fd, void *data, size_t length)
+{
+  char *bytes = data;
+  ssize_t n;
+
+  while (length > 0)
+  {
+    n = write(fd, bytes, length);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return (false);
+    bytes += n;
+    length -= n;
+  }
+  return (true);
+}
+
+/**
+ * @brief Sends a line of text to a client.
+ */
+static boolean SendLine(int fd, char *line)
+{
+  return (SendAll(fd, line, strlen(line)));
+}
+
+/**
+ * @brief Counts the latency of a request in the histogram.
+ */
+static void CountLatency(struct timespec *start)
+{
+  struct timespec end;
+  long microseconds;
+  int bin = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  microseconds = (end.tv_sec - start->tv_sec) * 1000000L + (end.tv_nsec - start->tv_nsec) / 1000;
+  while (bin < LATENCY_BINS - 1 && (1L << (bin + 1)) <= microseconds)
+    bin++;
+  pthread_mutex_lock(&statsLock);
+  latency[bin]++;
+  pthread_mutex_unlock(&statsLock);
+}
+
+/**
+ * @brief Answers a stats request with the latency histogram: a line with the
+ * number of bins that follow and a line "<from> <to> <requests>" per non-empty
+ * bin, in microseconds.
+ */
+static boolean SendStats(int fd)
+{
+  long counts[LATENCY_BINS];
+  char line[128];
+  int bin, bins = 0;
+
+  pthread_mutex_lock(&statsLock);
+  memcpy(counts, latency, sizeof(counts));
+  pthread_mutex_unlock(&statsLock);
+  for (bin = 0; bin < LATENCY_BINS; bin++)
+    bins += counts[bin] > 0;
+  snprintf(line, sizeof(line), "ok %d\n", bins);
+  if (!SendLine(fd, line))
+    return (false);
+  for (bin = 0; bin < LATENCY_BINS; bin++)
+  {
+    if (counts[bin] == 0)
+      continue;
+    snprintf(line, sizeof(line), "%ld %ld %ld\n", bin ? 1L << bin : 0L, 1L << (bin + 1), counts[bin]);
+    if (!SendLine(fd, line))
+      return (false);
+  }
+  return (true);
+}
+
+/**
+ * @brief Renders a rectangle of the output of SalienceTreeAttributeFilter. The
+ * direct rule is rendered from the shared tree by SalienceTreeRegionFilter, the
+ * other rules filter the whole tree, which writes the colours into its nodes, and
+ * copy the rectangle. Pixels outside the image are black.
+ *
+ * @return boolean false if there is not enough memory
+ */
+static boolean FilterRegion(TreeEntry *entry, Pixel *view, int x, int y, int w, int h,
+                            FilterPredicate *predicate, int rule)
+{
+  SalienceTree *tree = entry->tree;
+  int imgwidth = tree->width, imgheight = tree->imgSize / tree->width, vx, vy;
+  Pixel *out;
+
+  if (rule == FILTER_DIRECT)
+  {
+    SalienceTreeRegionFilter(tree, view, x, y, w, h, predicate);
+    return (true);
+  }
+  out = malloc((size_t)tree->imgSize * sizeof(Pixel));
+  if (out == NULL)
+    return (false);
+  pthread_mutex_lock(&entry->filterLock);
+  SalienceTreeAttributeFilter(tree, out, predicate, rule);
+  pthread_mutex_unlock(&entry->filterLock);
+  for (vy = 0; vy < h; vy++)
+    for (vx = 0; vx < w; vx++)
+    {
+      if (x + vx < 0 || x + vx >= imgwidth || y + vy < 0 || y + vy >= imgheight)
+        memset(view[(Index)vy * w + vx], 0, sizeof(Pixel));
+      else
+        memcpy(view[(Index)vy * w + vx], out[(Index)(y + vy) * imgwidth + x + vx], sizeof(Pixel));
+    }
+  free(out);
+  return (true);
+}
+
+/**
+ * @brief Answers a render request
+ * "render <image> <lambdamin> <lambda>[,<lambda>...] [<x> <y> <width> <height>]"
+ * with a line "ok <width> <height> <images>" followed by the salience filtered
+ * pixels of the rectangle, or of the whole image, for every lambda in turn.
+ * The images are rendered with SalienceTreeSalienceRegion, which only reads the
+ * shared tree. "render <image> <lambdamin> filter <predicate> <rule> [...]"
+ * renders one image of the attribute filter of a -filter predicate without
+ * spaces, like "area>=100,salience>=20", and a -rule, see FilterRegion.
+ */
+static boolean SendRender(int fd, char *request)
+{
+  char path[REQUEST_MAX], lambdas[REQUEST_MAX], filter[REQUEST_MAX], rulename[16], line[128], *text, *end;
+  double lambdamin, lambda[LAMBDAS_MAX];
+  int fields, count = 0, x = 0, y = 0, w = 0, h = 0, k, rule = -1;
+  FilterPredicate predicate;
+  TreeEntry *entry;
+  Pixel *view;
+  boolean whole, sent;
+
+  fields = sscanf(request, "render %4095s %lf filter %4095s %15s %d %d %d %d",
+                  path, &lambdamin, filter, rulename, &x, &y, &w, &h);
+  if (fields == 4 || fields == 8)
+  {
+    if (!ParseFilterPredicate(filter, &predicate))
+      return (SendLine(fd, "error invalid filter\n"));
+    if ((rule = ParseFilterRule(rulename)) < 0)
+      return (SendLine(fd, "error invalid rule\n"));
+    whole = (fields == 4);
+    count = 1;
+  }
+  else
+  {
+    fields = sscanf(request, "render %4095s %lf %4095s %d %d %d %d", path, &lambdamin, lambdas, &x, &y, &w, &h);
+    if (fields != 3 && fields != 7)
+      return (SendLine(fd, "error usage: render <image> <lambdamin> <lambda>[,<lambda>...]|filter <predicate> <rule> [<x> <y> <width> <height>]\n"));
+    for (text = lambdas;; text = end + 1)
+    {
+      if (count == LAMBDAS_MAX)
+        return (SendLine(fd, "error too many lambdas\n"));
+      lambda[count++] = strtod(text, &end);
+      if (end == text || (*end != ',' && *end != '\0'))
+        return (SendLine(fd, "error invalid lambda\n"));
+      if (*end == '\0')
+        break;
+    }
+    whole = (fields == 3);
+  }
+  if (!whole && (w <= 0 || h <= 0))
+    return (SendLine(fd, "error invalid rectangle\n"));
+  entry = AcquireEntry(path, lambdamin);
+  if (entry == NULL)
+    return (SendLine(fd, "error can not read the image\n"));
+  if (whole)
+  {
+    w = entry->tree->width;
+    h = entry->tree->imgSize / w;
+  }
+  view = malloc((size_t)w * h * sizeof(Pixel));
+  if (view == NULL || (rule >= 0 && !FilterRegion(entry, view, x, y, w, h, &predicate, rule)))
+  {
+    ReleaseEntry(entry);
+    free(view);
+    return (SendLine(fd, "error out of memory\n"));
+  }
+  snprintf(line, sizeof(line), "ok %d %d %d\n", w, h, count);
+  sent = SendLine(fd, line);
+  if (rule >= 0)
+    sent = sent && SendAll(fd, view, (size_t)w * h * sizeof(Pixel));
+  for (k = 0; k < count && sent && rule < 0; k++)
+  {
+    SalienceTreeSalienceRegion(entry->tree, view, x, y, w, h, lambda[k]);
+    sent = SendAll(fd, view, (size_t)w * h * sizeof(Pixel));
+  }
+  ReleaseEntry(entry);
+  free(view);
+  return (sent);
+}
+
+/**
+ * @brief Serves the requests of one client, one per line, until it disconnects.
+ */
+static void *ServeClient(void *arg)
+{
+  int fd = *(int *)arg;
+  char request[REQUEST_MAX];
+  struct timespec start;
+  boolean open = true;
+  FILE *input;
+
+  free(arg);
+  input = fdopen(fd, "r");
+  while (open && input != NULL && fgets(request, sizeof(request), input) != NULL)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (strncmp(request, "render ", 7) == 0)
+      open = SendRender(fd, request);
+    else if (strncmp(request, "stats", 5) == 0)
+      open = SendStats(fd);
+    else
+      open = SendLine(fd, "error unknown request\n");
+    CountLatency(&start);
+  }
+  if (input != NULL)
+    fclose(input);
+  else
+    close(fd);
+  return (NULL);
+}
+
+/**
+ * @brief Serves salience filtered images of cached trees over a Unix domain
+ * socket. Every client gets its own thread and sends requests of one line:
+ * "render <image> <lambdamin> <lambda>[,<lambda>...] [<x> <y> <width> <height>]"
+ * renders the whole image or a rectangle for one or more lambdas, with
+ * "filter <predicate> <rule>" in place of the lambdas for an attribute filter,
+ * and "stats" returns the latency histogram of all requests so far. The trees
+ * of the most recently used images are kept, keyed by the path, modification
+ * time and size of the image and lambdamin, and shared by all clients.
+ *
+ * @param socketPath Path of the socket
+ * @param cacheSize Number of trees to keep
+ * @return int -1 if the socket can not be opened, the server does not return otherwise
+ */
+int RunTreeServer(char *socketPath, int cacheSize)
+{
+  struct sockaddr_un address;
+  pthread_t thread;
+  int listener, *fd;
+
+  cacheCapacity = MAX(1, cacheSize);
+  cacheSlots = cacheCapacity + 1;
+  cache = malloc(cacheSlots * sizeof(TreeEntry *));
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+  unlink(socketPath);
+  if (cache == NULL || listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 16) != 0)
+  {
+    fprintf(stderr, "Error: Can't listen on the socket: %s !", socketPath);
+    return (-1);
+  }
+  // a client that disconnects during a reply only ends its own thread
+  signal(SIGPIPE, SIG_IGN);
+  printf("Serving trees on '%s'\n", socketPath);
+  fflush(stdout);
+  while (true)
+  {
+    fd = malloc(sizeof(int));
+    if (fd == NULL)
+    {
+      fprintf(stderr, "Out of memory!");
+      exit(-1);
+    }
+    *fd = accept(listener, NULL, NULL);
+    if (*fd < 0)
+    {
+      free(fd);
+      continue;
+    }
+    if (pthread_create(&thread, NULL, ServeClient, fd) != 0)
+    {
+      close(*fd);
+      free(fd);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  return (0);
+}
@@ -0,0 +1,30 @@
+#ifndef TREE_SERVER_H
+#define TREE_SERVER_H
+
+#include "common.h"
+#include "../source/SalienceTree.h"
+#include <pthread.h>
+
+// request latencies are counted in bins of powers of two microseconds
+#define LATENCY_BINS 32
+
+// A built tree in the cache of the server. Entries are shared by all clients,
+// the trees are only read after SharedTree has prepared them, except for the
+// output colours of the attribute filter, which filterLock guards.
+// The version of an image is told by its modification time in seconds and its
+// size, the contents are not compared.
+typedef struct TreeEntry
+{
+  char *path;
+  long mtime, fsize;  /* identify the version of the image */
+  double lambdamin;
+  SalienceTree *tree;
+  int users;          /* requests using the tree, it is not evicted while in use */
+  pthread_mutex_t filterLock; /* one attribute filter of the whole tree at a time */
+  long lastUse;       /* request counter at the last lookup, for the LRU order */
+} TreeEntry;
+
+void SharedTree(SalienceTree *tree);
+int RunTreeServer(char *socketPath, int cacheSize);
+
+#endif
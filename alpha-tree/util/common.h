@@ -5,34 +5,126 @@
  * 
  */
 
+#ifndef COMMON_H
+#define COMMON_H
+
 #include <stdio.h>
 
-// Globally used macros
+// Globally used macros, the ones that other headers define as well are kept
 #define BOTTOM (-1)
+#ifndef __cplusplus
+#ifndef false
 #define false 0
+#endif
+#ifndef true
 #define true 1
+#endif
+#endif
+#ifndef MIN
 #define MIN(a, b) ((a <= b) ? (a) : (b))
+#endif
+#ifndef MAX
 #define MAX(a, b) ((a >= b) ? (a) : (b))
+#endif
 
 #define CONNECTIVITY 4
 
+// Progress of a build on stderr, the library (make lib) builds quietly
+#ifdef SALIENCE_LIBRARY
+#define Progress(...) do { } while (0)
+#else
+#define Progress(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+// The pixel type is chosen at compile time, every part of the build pipeline is
+// compiled for one combination of channel count and channel depth, e.g.
+// make CHANNELS=8 CHANNEL_BITS=16 for 16-bit images with 8 bands
+#ifndef CHANNELS
+#define CHANNELS 3
+#endif
+#ifndef CHANNEL_BITS
+#define CHANNEL_BITS 8
+#endif
+
+// The attributes of the nodes that are maintained while the tree is built are
+// chosen at compile time as well, e.g. make ATTRIBUTES="AREA RANGE". Every
+// attribute that is not selected is compiled out of MakeSet and the unions.
+// A build without attributes (make ATTRIBUTES=NONE) only builds the hierarchy.
+// ATTRIBUTE_AREA: number of pixels of a node
+// ATTRIBUTE_MEAN: sum of the pixel values, the filters need it for the mean colour
+// ATTRIBUTE_RANGE: minimum and maximum pixel values, omega needs them
+// ATTRIBUTE_BBOX: bounding box of the pixels
+// ATTRIBUTE_MOMENTS: first and second order moments of the pixel coordinates
+// ATTRIBUTE_PERIMETER: number of pixel sides on the boundary, an approximation, needs AREA
+// Sources compiled without the Makefile get all attributes.
+#ifndef ATTRIBUTES_SELECTED
+#define ATTRIBUTE_AREA
+#define ATTRIBUTE_MEAN
+#define ATTRIBUTE_RANGE
+#endif
+#if defined(ATTRIBUTE_MEAN) && !defined(ATTRIBUTE_AREA)
+#error "ATTRIBUTE_MEAN needs ATTRIBUTE_AREA"
+#endif
+#if defined(ATTRIBUTE_PERIMETER) && !defined(ATTRIBUTE_AREA)
+#error "ATTRIBUTE_PERIMETER needs ATTRIBUTE_AREA"
+#endif
+
 // Custom types needed
 typedef short boolean;
 typedef unsigned char ubyte;
+typedef unsigned short ushort;
 // ubyte is an 8-bit unsigned integral data type range [0,255]
-// => Pixel is an array of 3 colors in range [0,255]
-typedef ubyte Pixel[3];
+// ushort is a 16-bit unsigned integral data type range [0,65535]
+// => Pixel is an array of CHANNELS values in range [0,CHANNEL_MAX]
+#if CHANNEL_BITS == 16
+typedef ushort Channel;
+#define CHANNEL_MAX 65535
+#elif CHANNEL_BITS == 8
+typedef ubyte Channel;
+#define CHANNEL_MAX 255
+#else
+#error "CHANNEL_BITS has to be 8 or 16"
+#endif
+typedef Channel Pixel[CHANNELS];
+
+// Pixels and nodes are indexed with 32 bits by default, which keeps the node and
+// root arrays compact. That is enough for images up to 2^30 pixels: the tree has
+// up to twice as many nodes as pixels and an edge keeps its direction in the two
+// lowest bits of its pixel index. make INDEX_BITS=64 builds for larger images.
+#ifndef INDEX_BITS
+#define INDEX_BITS 32
+#endif
+#if INDEX_BITS == 64
+typedef long Index;
+typedef unsigned long UIndex;
+#define INDEX_PIXELS_MAX ((1L << 61) - 1)
+#elif INDEX_BITS == 32
+typedef int Index;
+typedef unsigned int UIndex;
+#define INDEX_PIXELS_MAX ((1L << 30) - 1)
+#else
+#error "INDEX_BITS has to be 32 or 64"
+#endif
 
 // constants 
-extern double RGBweight[3];
+extern double ChannelWeight[CHANNELS];
 extern double MainEdgeWeight;
 extern double OrthogonalEdgeWeight;
 
 // variables
-extern int width, height, size;
+extern int width, height;
+extern Index size;
 extern int lambda;
 extern double omegafactor;
+extern boolean scanlinePhase1;
+extern boolean compactTree;
+extern long maxQueueEdges;
+extern double alphaStep;
+extern int hugePages;
+extern boolean pageStats;
 
 // input and output images as arrays of pixel
 extern Pixel *gval;
-extern Pixel *out;
\ No newline at end of file
+extern Pixel *out;
+
+#endif
@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# Builds the salience tree of a binary (P6) ppm image with one worker process
+# per tile and merges the partial trees into a filtered output image.
+# usage: tiled-build.sh <input image> <lambda> <tiles> [output image]
+
+if [ $# -lt 3 ]
+then
+    echo "usage: $0 <input image> <lambda> <tiles> [output image]"
+    exit 1
+fi
+
+input=$1
+lambda=$2
+tiles=$3
+output=${4:-out.ppm}
+bin=$(dirname "$0")/../alpha-tree/saliencetree
+
+# the height is the second number of the ppm header (comments are skipped)
+height=$(head -c 1024 "$input" | tr -d '\r' | grep -av '^#' | tr -s ' \n' ' ' | cut -d ' ' -f 3)
+rows=$(( (height + tiles - 1) / tiles ))
+parts=()
+pids=()
+
+for (( tile = 0; tile < tiles; tile++ ))
+do
+    first=$(( tile * rows ))
+    last=$(( first + rows < height ? first + rows : height ))
+    if [ $first -ge $last ]
+    then
+        break
+    fi
+    part=$(mktemp --suffix=.part)
+    parts+=("$part")
+    "$bin" -tile "$input" "$lambda" $first $last "$part" &
+    pids+=($!)
+done
+
+# every worker has to finish before the partial trees can be merged, a tile
+# that failed leaves a hole the merge can not fill
+failed=0
+for pid in "${pids[@]}"
+do
+    if ! wait $pid
+    then
+        failed=1
+    fi
+done
+if [ $failed -ne 0 ]
+then
+    echo "$0: building a tile failed" >&2
+    rm -f "${parts[@]}"
+    exit 1
+fi
+"$bin" -merge "$lambda" "$output" "${parts[@]}"
+status=$?
+rm -f "${parts[@]}"
+exit $status